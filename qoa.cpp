@@ -4,228 +4,1032 @@
 
 #include "qoa.h"
 
+#include "qoa_endian.h"
+#include "qoa_format.h"
+
 #include <algorithm>
 #include <array>
-#include <bit>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <istream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <span>
 #include <utility>
 #include <vector>
 
-namespace util {
-template <typename T> T net_pack(const T in) {
-  T out{};
-  auto *const bytes = reinterpret_cast<std::byte *>(&out);
-
-  for (std::size_t i = 0; i < sizeof(T); ++i) {
-    bytes[i] = static_cast<std::byte>(in >> ((sizeof(T) - i - 1) * CHAR_BIT));
-  }
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
-  return out;
-}
-} // namespace util
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QOA_SSE2 1
+#endif
 
 namespace qoa {
 namespace {
 
-static_assert((std::endian::native == std::endian::big) ||
-                  (std::endian::native == std::endian::little),
-              "Mixed endian is unsupported right now");
-
 struct FrameHeader {
   std::uint8_t channel_count{};
   std::uint32_t sample_rate{}; // u24 in the spec.
   std::uint16_t sample_count{};
   std::uint16_t size{};
 
-  static std::optional<FrameHeader> parse(std::istream &is) {
-    FrameHeader h{};
-    if (!is.read(reinterpret_cast<char *>(&h.channel_count),
-                 sizeof(h.channel_count))) {
-      return std::nullopt;
-    }
+  static constexpr FrameHeader parse(std::uint8_t const *data) {
+    return FrameHeader{
+        .channel_count = load_be<std::uint8_t>(data),
+        .sample_rate = load_be24(data + 1),
+        .sample_count = load_be<std::uint16_t>(data + 4),
+        .size = load_be<std::uint16_t>(data + 6),
+    };
+  }
+};
+
+constexpr std::uint32_t parsed_sample_rate(std::array<std::uint8_t, 8> hdr) {
+  return FrameHeader::parse(hdr.data()).sample_rate;
+}
+
+static_assert(parsed_sample_rate({1, 0x00, 0xac, 0x44, 0, 20, 0, 32}) == 44100);
+static_assert(parsed_sample_rate({1, 0x00, 0xbb, 0x80, 0, 20, 0, 32}) == 48000);
+static_assert(parsed_sample_rate({1, 0x01, 0x77, 0x00, 0, 20, 0, 32}) == 96000);
+static_assert(parsed_sample_rate({1, 0xff, 0xff, 0xff, 0, 20, 0, 32}) ==
+              0xffffff);
 
-    // The spec has this as a 24-bit unsigned integer.
-    if (!is.read(reinterpret_cast<char *>(&h.sample_rate), 3)) {
-      return std::nullopt;
+// [1] kScaleFactorTable is in qoa_format.h, with the rest of the layout.
+
+// [2] Each quantized residual is an index into the kDequantTable.
+constexpr std::array<float, 8> kDequantTable{
+    .75f, -.75f, 2.5f, -2.5f, 4.5f, -4.5f, 7.f, -7.f,
+};
+
+// [3] Multiply with scale factor, round to nearest, tie away from 0. Done
+// ahead of time for every scale factor so decoding is a single lookup.
+constexpr auto kDequantLut = [] {
+  std::array<std::array<int, 8>, 16> lut{};
+  for (std::size_t sf = 0; sf < lut.size(); ++sf) {
+    for (std::size_t q = 0; q < lut[sf].size(); ++q) {
+      float r = static_cast<float>(kScaleFactorTable[sf]) * kDequantTable[q];
+      lut[sf][q] =
+          r < 0 ? static_cast<int>(r - .5f) : static_cast<int>(r + .5f);
     }
+  }
+  return lut;
+}();
+
+static_assert(kDequantLut[0] == std::array{1, -1, 3, -3, 5, -5, 7, -7});
+
+// Checked whatever the Validation, since decoding a frame that fails this
+// would write past the end of the output.
+bool frame_decodable(FrameHeader const &hdr) {
+  return hdr.sample_count != 0 && hdr.sample_count <= kFrameLen;
+}
 
-    if (!is.read(reinterpret_cast<char *>(&h.sample_count),
-                 sizeof(h.sample_count))) {
-      return std::nullopt;
+// What a frame's header has to agree with, besides itself.
+struct FrameContext {
+  std::uint32_t channels{};
+  std::uint32_t sample_rate{};
+  // Per channel, from the file header. 0 for streams.
+  std::uint32_t file_samples{};
+  // Of the frame, per channel.
+  std::uint64_t first_sample{};
+  // Whether the frame is the last one in the file.
+  bool last{};
+};
+
+template <Validation V>
+bool frame_consistent(FrameHeader const &hdr, FrameContext const &ctx) {
+  if constexpr (V != Validation::Trusted) {
+    auto const slices = (hdr.sample_count + kSliceLen - 1) / kSliceLen;
+    if (hdr.channel_count != ctx.channels || hdr.sample_rate == 0 ||
+        hdr.size != frame_size(ctx.channels, slices)) {
+      return false;
     }
+  }
 
-    if (!is.read(reinterpret_cast<char *>(&h.size), sizeof(h.size))) {
-      return std::nullopt;
+  if constexpr (V == Validation::Strict) {
+    if (hdr.sample_rate != ctx.sample_rate ||
+        (!ctx.last && hdr.sample_count != kFrameLen)) {
+      return false;
     }
 
-    if constexpr (std::endian::native != std::endian::big) {
-      // TODO(robinlinden): u24, byteswap weirdness?
-      h.sample_rate = util::net_pack(h.sample_rate);
-      h.sample_count = util::net_pack(h.sample_count);
-      h.size = util::net_pack(h.size);
+    auto const end = ctx.first_sample + hdr.sample_count;
+    if (ctx.file_samples != 0 &&
+        (ctx.last ? end != ctx.file_samples : end >= ctx.file_samples)) {
+      return false;
     }
+  }
+
+  return true;
+}
+
+// unpack_slice() may write this many residuals, since it works in whole
+// vectors when it can.
+constexpr std::size_t kUnpackedSliceLen = 24;
 
-    return h;
+// Slices per channel that decode_slices() unpacks before running the LMS
+// recursion over them. Bounds its residual buffer to ~20 KiB of stack.
+constexpr std::size_t kSlicesPerPass = 32;
+
+// Unpacks the scale factor and all 20 residuals of a slice up front. Every
+// residual is at a fixed bit offset, so there's no running offset and no
+// dependency between them or on the LMS state.
+void unpack_slice(std::uint64_t slice, int *residuals) {
+  auto const &dequant = kDequantLut[slice >> 60];
+#ifdef __AVX2__
+  // Residuals 0-9 are in bits 30-59 and 10-19 in bits 0-29, so each half
+  // fits in a 32-bit lane and can be shifted into place per lane. The
+  // dequant row for the scale factor is exactly one 8-lane register, so the
+  // lookup is a permute.
+  auto const hi = static_cast<int>(slice >> 30);
+  auto const lo = static_cast<int>(slice & 0x3fff'ffff);
+  std::array const sources{
+      _mm256_set1_epi32(hi),
+      _mm256_setr_epi32(hi, hi, lo, lo, lo, lo, lo, lo),
+      _mm256_set1_epi32(lo),
+  };
+  std::array const shifts{
+      _mm256_setr_epi32(27, 24, 21, 18, 15, 12, 9, 6),
+      _mm256_setr_epi32(3, 0, 27, 24, 21, 18, 15, 12),
+      _mm256_setr_epi32(9, 6, 3, 0, 0, 0, 0, 0),
+  };
+  auto const row =
+      _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dequant.data()));
+  auto const mask = _mm256_set1_epi32(0b111);
+  for (std::size_t i = 0; i < sources.size(); ++i) {
+    auto const q =
+        _mm256_and_si256(_mm256_srlv_epi32(sources[i], shifts[i]), mask);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(residuals + i * 8),
+                        _mm256_permutevar8x32_epi32(row, q));
   }
-};
+#else
+  for (std::size_t i = 0; i < kSliceLen; ++i) {
+    residuals[i] = dequant[(slice >> (57 - 3 * i)) & 0b111];
+  }
+#endif
+}
 
-struct LmsState {
-  std::array<std::int16_t, 4> history{};
-  std::array<std::int16_t, 4> weights{};
+// Runs the LMS filter over `n` dequantized residuals, writing the samples
+// `stride` apart. The state is kept in plain scalars for the whole run so
+// the compiler keeps it in registers instead of spilling a vector of
+// weights to the stack every sample.
+template <typename Stride>
+void run_lms(LmsState &lms, int const *residuals, std::size_t n,
+             std::int16_t *out, Stride stride) {
+  auto [h0, h1, h2, h3] = lms.history;
+  auto [w0, w1, w2, w3] = lms.weights;
+  for (std::size_t i = 0; i < n; ++i) {
+    int r = residuals[i];
+
+    // [4] The predicted sample is the sum of history[n] * weight[n] >>= 13.
+    // The weights start from whatever the file says, so the sum is done in
+    // 64 bits. A frame can only move them so far, so the shifted sum fits.
+    int p = static_cast<int>(
+        (std::int64_t{h0} * w0 + std::int64_t{h1} * w1 +
+         std::int64_t{h2} * w2 + std::int64_t{h3} * w3) >>
+        13);
+
+    // [5] The final sample is p + r, clamped to the signed 16-bit range.
+    int sample = std::clamp(p + r, -32768, 32767);
+    out[i * stride] = static_cast<std::int16_t>(sample);
+
+    // [6] The LMS weights are updated using the quantized and scaled
+    // residual r, right-shifted by 4 bits.
+    int delta = r >> 4;
+    w0 += h0 < 0 ? -delta : delta;
+    w1 += h1 < 0 ? -delta : delta;
+    w2 += h2 < 0 ? -delta : delta;
+    w3 += h3 < 0 ? -delta : delta;
+    h0 = h1;
+    h1 = h2;
+    h2 = h3;
+    h3 = sample;
+  }
 
-  static std::optional<LmsState> parse(std::istream &is) {
-    LmsState s{};
-    if (!is.read(reinterpret_cast<char *>(s.history.data()),
-                 sizeof(s.history.size() * 2))) {
-      return std::nullopt;
+  lms.history = {h0, h1, h2, h3};
+  lms.weights = {w0, w1, w2, w3};
+}
+
+// Decodes `samples` interleaved samples per channel from slices laid out as
+// in a frame, slice n of every channel followed by slice n + 1.
+//
+// This is done in two passes over up to kSlicesPerPass slices at a time:
+// first every slice is unpacked into a per-channel residual buffer, which
+// has no dependencies between slices, then the inherently serial LMS
+// recursion runs over each channel's residuals without interruption.
+//
+// kChannels is the channel count for the common layouts, which lets the
+// channel loops unroll and the output stride be a constant, or 0 to take it
+// from lms.size().
+template <std::size_t kChannels>
+void decode_slices(std::span<LmsState> lms, std::uint8_t const *slices,
+                   std::size_t samples, std::int16_t *out) {
+  constexpr std::size_t kPassLen = kSlicesPerPass * kSliceLen;
+  // Padded so the last slice's extra residuals don't spill into the next
+  // channel.
+  constexpr std::size_t kChannelStride =
+      kPassLen + kUnpackedSliceLen - kSliceLen;
+  std::array<int, kChannelStride *(kChannels == 0 ? kMaxChannels : kChannels)>
+      residuals;
+
+  auto const channels = [&] {
+    if constexpr (kChannels == 0) {
+      return lms.size();
+    } else {
+      return std::integral_constant<std::size_t, kChannels>{};
     }
+  }();
 
-    if (!is.read(reinterpret_cast<char *>(s.weights.data()),
-                 sizeof(s.weights.size() * 2))) {
-      return std::nullopt;
+  for (std::size_t done = 0; done < samples;) {
+    auto const n = std::min(samples - done, kPassLen);
+    for (std::size_t i = 0; i < n; i += kSliceLen) {
+      for (std::size_t ch = 0; ch < channels; ++ch) {
+        unpack_slice(load_be<std::uint64_t>(slices),
+                     &residuals[ch * kChannelStride + i]);
+        slices += kSliceSize;
+      }
     }
 
-    if constexpr (std::endian::native != std::endian::big) {
-      for (int i = 0; i < 4; ++i) {
-        s.history[i] = util::net_pack(s.history[i]);
-        s.weights[i] = util::net_pack(s.weights[i]);
+    for (std::size_t ch = 0; ch < channels; ++ch) {
+      run_lms(lms[ch], &residuals[ch * kChannelStride], n,
+              out + done * channels + ch, channels);
+    }
+
+    done += n;
+  }
+}
+
+// Whether the slices all use scale factor 0, and the LMS history starts out
+// close to 0, see DecodeOptions::skip_silence. This is one OR per slice,
+// against the ~20 multiply-adds decoding it would be.
+bool is_silent(std::span<LmsState const> lms, std::uint8_t const *slices,
+               std::size_t count) {
+  for (auto const &state : lms) {
+    for (auto h : state.history) {
+      if (h < -kSilenceThreshold || h > kSilenceThreshold) {
+        return false;
       }
     }
+  }
 
-    return s;
+  // The scale factor is in the top 4 bits of the first byte.
+  std::uint8_t sf = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    sf |= slices[i * kSliceSize];
   }
-};
 
-// [2] Each quantized residual is an index into the kDequantTable.
-constexpr std::array<float, 8> kDequantTable{
-    .75f, -.75f, 2.5f, -2.5f, 4.5f, -4.5f, 7.f, -7.f,
+  return sf >> 4 == 0;
+}
+
+void fill_silence(std::span<LmsState const> lms, std::size_t n,
+                  std::int16_t *out) {
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t ch = 0; ch < lms.size(); ++ch) {
+      out[i * lms.size() + ch] = static_cast<std::int16_t>(lms[ch].history[3]);
+    }
+  }
+}
+
+// Adds up to kFrameLen interleaved samples per channel to the statistics.
+//
+// Vectors of 8 samples line up with the channels again every `period`
+// vectors, 1 for 1, 2, 4 and 8 channels, so each of those gets its own
+// accumulators, which are folded into the channels their lanes hold at the
+// end. Squares are widened to 64 bits right away, everything else fits in
+// its lanes for a frame's worth of samples.
+void accumulate_stats(DecodeStats &stats, std::int16_t const *samples,
+                      std::size_t n, std::size_t channels) {
+  stats.samples += n;
+  auto const total = n * channels;
+  std::size_t i = 0;
+#ifdef QOA_SSE2
+  constexpr std::size_t kLanes = 8;
+  struct Accumulators {
+    __m128i max = _mm_set1_epi16(-32768);
+    __m128i min = _mm_set1_epi16(32767);
+    __m128i clipped = _mm_setzero_si128();
+    __m128i sum_lo = _mm_setzero_si128();
+    __m128i sum_hi = _mm_setzero_si128();
+    // Lanes 0 and 1, 2 and 3, and so on.
+    __m128i squares01 = _mm_setzero_si128();
+    __m128i squares23 = _mm_setzero_si128();
+    __m128i squares45 = _mm_setzero_si128();
+    __m128i squares67 = _mm_setzero_si128();
+  };
+
+  auto const period = channels / std::gcd(channels, kLanes);
+  std::array<Accumulators, kMaxChannels> acc{};
+  auto const zero = _mm_setzero_si128();
+  auto const top = _mm_set1_epi16(32767);
+  auto const bottom = _mm_set1_epi16(-32768);
+  for (; i + kLanes * period <= total; i += kLanes * period) {
+    for (std::size_t k = 0; k < period; ++k) {
+      auto &a = acc[k];
+      auto const v = _mm_loadu_si128(
+          reinterpret_cast<__m128i const *>(samples + i + k * kLanes));
+      a.max = _mm_max_epi16(a.max, v);
+      a.min = _mm_min_epi16(a.min, v);
+      // Matches are -1, so subtracting them counts them.
+      a.clipped = _mm_sub_epi16(a.clipped,
+                                _mm_or_si128(_mm_cmpeq_epi16(v, top),
+                                             _mm_cmpeq_epi16(v, bottom)));
+      a.sum_lo = _mm_add_epi32(a.sum_lo,
+                               _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+      a.sum_hi = _mm_add_epi32(a.sum_hi,
+                               _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+      // Each sample paired with a 0, so madd squares it into 32 bits.
+      auto const lo = _mm_unpacklo_epi16(v, zero);
+      auto const hi = _mm_unpackhi_epi16(v, zero);
+      auto const sq_lo = _mm_madd_epi16(lo, lo);
+      auto const sq_hi = _mm_madd_epi16(hi, hi);
+      a.squares01 =
+          _mm_add_epi64(a.squares01, _mm_unpacklo_epi32(sq_lo, zero));
+      a.squares23 =
+          _mm_add_epi64(a.squares23, _mm_unpackhi_epi32(sq_lo, zero));
+      a.squares45 =
+          _mm_add_epi64(a.squares45, _mm_unpacklo_epi32(sq_hi, zero));
+      a.squares67 =
+          _mm_add_epi64(a.squares67, _mm_unpackhi_epi32(sq_hi, zero));
+    }
+  }
+
+  for (std::size_t k = 0; i > 0 && k < period; ++k) {
+    std::array<std::int16_t, kLanes> max, min, clipped;
+    std::array<std::int32_t, kLanes> sum;
+    std::array<std::uint64_t, kLanes> squares;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(max.data()), acc[k].max);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(min.data()), acc[k].min);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(clipped.data()),
+                     acc[k].clipped);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sum.data()), acc[k].sum_lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sum.data() + 4),
+                     acc[k].sum_hi);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(squares.data()),
+                     acc[k].squares01);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(squares.data() + 2),
+                     acc[k].squares23);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(squares.data() + 4),
+                     acc[k].squares45);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(squares.data() + 6),
+                     acc[k].squares67);
+
+    for (std::size_t j = 0; j < kLanes; ++j) {
+      auto &ch = stats.channels[(k * kLanes + j) % channels];
+      ch.peak = std::max({ch.peak, int{max[j]}, -int{min[j]}});
+      ch.clipped += static_cast<std::uint16_t>(clipped[j]);
+      ch.sum += sum[j];
+      ch.sum_of_squares += squares[j];
+    }
+  }
+#endif
+
+  for (; i < total; ++i) {
+    auto &ch = stats.channels[i % channels];
+    int const s = samples[i];
+    ch.peak = std::max(ch.peak, std::abs(s));
+    ch.clipped += s == 32767 || s == -32768;
+    ch.sum += s;
+    ch.sum_of_squares += static_cast<std::uint64_t>(s * s);
+  }
+}
+
+// Picks the decode_slices() to use for a file, once.
+Decoder::DecodeSlicesFn select_decode_slices(std::size_t channels) {
+  switch (channels) {
+  case 1:
+    return decode_slices<1>;
+  case 2:
+    return decode_slices<2>;
+  case 6:
+    return decode_slices<6>;
+  case 8:
+    return decode_slices<8>;
+  default:
+    return decode_slices<0>;
+  }
+}
+
+// Encoding, as in the reference encoder.
+
+// The quantized residual for a scaled residual of -8 to 8.
+constexpr std::array<std::uint64_t, 17> kQuantTable{
+    7, 7, 7, 5, 5, 3, 3, 1, 0, 0, 2, 2, 4, 4, 6, 6, 6,
 };
 
+// 16.16 fixed-point reciprocals of the scale factors.
+constexpr auto kReciprocalTable = [] {
+  std::array<int, 16> table{};
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    table[i] = ((1 << 16) + kScaleFactorTable[i] - 1) / kScaleFactorTable[i];
+  }
+  return table;
+}();
+
+// Divides by the scale factor, rounding away from 0 so that the result
+// never quantizes to 0 unless v does.
+int scale_residual(int v, std::size_t sf) {
+  auto const n = static_cast<int>(
+      (std::int64_t{v} * kReciprocalTable[sf] + (1 << 15)) >> 16);
+  return n + ((v > 0) - (v < 0)) - ((n > 0) - (n < 0));
+}
+
+// In 64 bits for the same reason as in run_lms().
+int predict(LmsState const &lms) {
+  std::int64_t sum = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    sum += std::int64_t{lms.history[i]} * lms.weights[i];
+  }
+
+  return static_cast<int>(sum >> 13);
+}
+
+void update(LmsState &lms, int sample, int residual) {
+  int delta = residual >> 4;
+  for (std::size_t i = 0; i < 4; ++i) {
+    lms.weights[i] += lms.history[i] < 0 ? -delta : delta;
+  }
+
+  lms.history = {lms.history[1], lms.history[2], lms.history[3], sample};
+}
+
+template <typename T> void append_be(std::vector<std::uint8_t> &out, T v) {
+  out.resize(out.size() + sizeof(T));
+  store_be(&out[out.size() - sizeof(T)], v);
+}
+
+// Tries every scale factor on a slice, starting with the one the previous
+// slice used, and keeps the one with the least error. Large weights are
+// penalized so they stay within the 16 bits they're stored in.
+std::uint64_t encode_slice(LmsState &lms, int &prev_sf,
+                           std::int16_t const *samples, std::size_t n,
+                           std::size_t stride) {
+  std::uint64_t best_error = UINT64_MAX;
+  std::uint64_t best_slice{};
+  LmsState best_lms{};
+  int best_sf{};
+  for (int i = 0; i < 16; ++i) {
+    auto const sf = static_cast<std::size_t>((i + prev_sf) % 16);
+    auto trial = lms;
+    std::uint64_t slice = sf;
+    std::uint64_t error = 0;
+    for (std::size_t s = 0; s < n && error < best_error; ++s) {
+      int const sample = samples[s * stride];
+      int const predicted = predict(trial);
+      int const scaled =
+          std::clamp(scale_residual(sample - predicted, sf), -8, 8);
+      auto const quantized = kQuantTable[static_cast<std::size_t>(scaled + 8)];
+      int const dequantized = kDequantLut[sf][quantized];
+      int const reconstructed =
+          std::clamp(predicted + dequantized, -32768, 32767);
+
+      std::int64_t weights = 0;
+      for (auto w : trial.weights) {
+        weights += std::int64_t{w} * w;
+      }
+      std::int64_t penalty = (weights >> 18) - 0x8ff;
+      penalty = std::max<std::int64_t>(penalty, 0);
+      std::int64_t const e = sample - reconstructed;
+      error += static_cast<std::uint64_t>(e * e + penalty * penalty);
+
+      update(trial, reconstructed, dequantized);
+      slice = slice << 3 | quantized;
+    }
+
+    if (error < best_error) {
+      best_error = error;
+      best_slice = slice;
+      best_lms = trial;
+      best_sf = static_cast<int>(sf);
+    }
+  }
+
+  lms = best_lms;
+  prev_sf = best_sf;
+  // A short last slice is padded with zeros.
+  return best_slice << (kSliceLen - n) * 3;
+}
+
+// The most samples `options` allow across all `channels` channels.
+std::size_t max_output_size(DecodeOptions const &options,
+                            std::uint32_t channels) {
+  auto const limit = options.sample_limit(channels);
+  return limit > std::numeric_limits<std::size_t>::max() / channels
+             ? std::numeric_limits<std::size_t>::max()
+             : static_cast<std::size_t>(limit * channels);
+}
+
+// Makes room for `size` samples in `output`, growing it geometrically like
+// the vector itself would, but never past `max_size`, so a decode that keeps
+// within the limits doesn't allocate more than they allow either.
+template <typename Vector>
+void grow(Vector &output, std::size_t size, std::size_t max_size) {
+  if (size > output.capacity()) {
+    output.reserve(std::max(size, std::min(output.capacity() * 2, max_size)));
+  }
+}
+
 } // namespace
 
+double DecodeStats::rms(std::size_t channel) const {
+  return samples == 0 ? 0
+                      : std::sqrt(static_cast<double>(
+                                      channels[channel].sum_of_squares) /
+                                  static_cast<double>(samples));
+}
+
+double DecodeStats::dc_offset(std::size_t channel) const {
+  return samples == 0 ? 0
+                      : static_cast<double>(channels[channel].sum) /
+                            static_cast<double>(samples);
+}
+
+bool DecodeOptions::allows(std::uint64_t samples,
+                          std::uint32_t channels) const {
+  return channels <= max_channels && samples <= sample_limit(channels);
+}
+
+std::uint64_t DecodeOptions::sample_limit(std::uint32_t channels) const {
+  auto limit = max_samples == 0 ? std::numeric_limits<std::uint64_t>::max()
+                                : max_samples;
+  if (max_memory != 0 && channels != 0) {
+    limit = std::min<std::uint64_t>(
+        limit, max_memory / (std::uint64_t{channels} * sizeof(std::int16_t)));
+  }
+
+  return limit;
+}
+
 // https://qoaformat.org/
-std::optional<Qoa> Qoa::parse(std::istream &is) {
-  std::array<char, 4> magic{};
-  FrameHeader last_frame;
-  if (!is.read(reinterpret_cast<char *>(magic.data()), magic.size()) ||
-      magic != std::array{'q', 'o', 'a', 'f'}) {
+template <typename Allocator>
+std::optional<BasicQoa<Allocator>>
+BasicQoa<Allocator>::parse(std::istream &is, DecodeOptions const &options,
+                           Allocator const &alloc) {
+  auto decoder = StreamDecoder::parse(is, options);
+  if (!decoder) {
+    return std::nullopt;
+  }
+
+  auto const sample_count = decoder->sample_count();
+  std::cout << "File contains " << sample_count << " across "
+            << (sample_count + kFrameLen - 1) / kFrameLen << " frames\n";
+
+  // The decoder checks every frame against the limits before yielding it.
+  auto const channels = decoder->nbr_channels();
+  auto const max_size = max_output_size(options, channels);
+  std::vector<std::int16_t, Allocator> output{alloc};
+  for (auto frame : decoder->frames()) {
+    grow(output, output.size() + frame.size(), max_size);
+    output.insert(output.end(), frame.begin(), frame.end());
+  }
+
+  if (decoder->error()) {
     return std::nullopt;
   }
 
-  std::uint32_t sample_count{};
-  if (!is.read(reinterpret_cast<char *>(&sample_count), sizeof(sample_count))) {
+  std::cerr << "Samples read: " << output.size() << '\n';
+  return BasicQoa{.audio_frames = std::move(output),
+                  .sample_rate = decoder->sample_rate(),
+                  .nbr_channels = channels};
+}
+
+template <typename Allocator>
+std::optional<BasicQoa<Allocator>>
+BasicQoa<Allocator>::parse(std::span<std::uint8_t const> data,
+                           DecodeOptions const &options,
+                           Allocator const &alloc) {
+  auto decoder = Decoder::parse(data, options);
+  if (!decoder) {
     return std::nullopt;
   }
 
-  if constexpr (std::endian::native != std::endian::big) {
-    sample_count = util::net_pack(sample_count);
+  auto const channels = decoder->nbr_channels();
+  auto const limit = options.sample_limit(channels);
+  auto const max_size = max_output_size(options, channels);
+  // Every 8-byte slice holds at most 20 samples, so the data bounds how much
+  // the header's sample count can make us reserve. The last decode is asked
+  // for a whole frame, so there's room for one more on top, which keeps the
+  // output from being reallocated when it's already full. Neither the output
+  // nor each decode goes past the limits, so a file that breaks them fails
+  // before more than they allow is allocated.
+  auto const max_samples = data.size() / kSliceSize * kSliceLen / channels;
+  std::vector<std::int16_t, Allocator> output{alloc};
+  output.reserve(std::min(
+      static_cast<std::size_t>(
+          std::min<std::uint64_t>(decoder->sample_count(), max_samples) +
+          kFrameLen) *
+          channels,
+      max_size));
+
+  std::uint64_t samples = 0;
+  while (true) {
+    auto const room = std::min<std::uint64_t>(kFrameLen, limit - samples);
+    if (room == 0) {
+      // Any sample more would go past the limits.
+      std::array<std::int16_t, kMaxChannels> next{};
+      if (decoder->decode(std::span{next}.first(channels)) != 0) {
+        return std::nullopt;
+      }
+      break;
+    }
+
+    auto const size = static_cast<std::size_t>((samples + room) * channels);
+    grow(output, size, max_size);
+    output.resize(size);
+    auto const n = decoder->decode(std::span{output}.subspan(
+        static_cast<std::size_t>(samples * channels)));
+    samples += n;
+    if (n < room) {
+      break;
+    }
+  }
+  output.resize(static_cast<std::size_t>(samples * channels));
+
+  if (decoder->error()) {
+    return std::nullopt;
+  }
+
+  return BasicQoa{.audio_frames = std::move(output),
+                  .sample_rate = decoder->sample_rate(),
+                  .nbr_channels = channels};
+}
+
+template class BasicQoa<std::allocator<std::int16_t>>;
+template class BasicQoa<std::pmr::polymorphic_allocator<std::int16_t>>;
+
+std::optional<Decoder> Decoder::parse(std::span<std::uint8_t const> data,
+                                      DecodeOptions const &options) noexcept {
+  if (data.size() < kFileHeaderSize + kFrameHeaderSize ||
+      !std::equal(data.begin(), data.begin() + 4, "qoaf")) {
+    return std::nullopt;
+  }
+
+  auto const first_frame = FrameHeader::parse(&data[kFileHeaderSize]);
+  if (first_frame.channel_count == 0 ||
+      first_frame.channel_count > kMaxChannels ||
+      !options.allows(load_be<std::uint32_t>(&data[4]),
+                      first_frame.channel_count)) {
+    return std::nullopt;
+  }
+
+  Decoder d;
+  d.data_ = data;
+  d.pos_ = kFileHeaderSize;
+  d.sample_count_ = load_be<std::uint32_t>(&data[4]);
+  d.sample_rate_ = first_frame.sample_rate;
+  d.channels_ = first_frame.channel_count;
+  d.decode_slices_ = select_decode_slices(d.channels_);
+  d.stats_ = options.stats;
+  d.skip_silence_ = options.skip_silence;
+  d.validation_ = options.validation;
+  return d;
+}
+
+bool Decoder::next_frame() noexcept {
+  switch (validation_) {
+  case Validation::Trusted:
+    return next_frame<Validation::Trusted>();
+  case Validation::Strict:
+    return next_frame<Validation::Strict>();
+  default:
+    return next_frame<Validation::Frame>();
+  }
+}
+
+template <Validation V> bool Decoder::next_frame() noexcept {
+  // Anything past the samples the file header promised isn't part of the
+  // file, as with StreamDecoder, and neither is less than a frame header.
+  // Only Strict requires there to be nothing there.
+  if ((sample_count_ != 0 && next_sample_ >= sample_count_) ||
+      data_.size() - pos_ < kFrameHeaderSize) {
+    error_ = V == Validation::Strict && pos_ != data_.size();
+    return false;
   }
 
-  std::uint32_t frame_count = std::round(sample_count / 256.f / 20.f + 0.5f);
+  auto const hdr = FrameHeader::parse(&data_[pos_]);
+  auto const slices = (hdr.sample_count + kSliceLen - 1) / kSliceLen;
+  auto const size = frame_size(channels_, slices);
+  if (!frame_decodable(hdr) || data_.size() - pos_ < size) {
+    error_ = true;
+    return false;
+  }
 
-  std::cout << "File contains " << sample_count << " across " << frame_count
-            << " frames\n";
-  std::array<std::vector<std::int16_t>, 2> output;
-  std::optional<std::uint8_t> channel_count{};
-  for (std::size_t frame_idx = 0; frame_idx < frame_count; ++frame_idx) {
-    auto frame_hdr = FrameHeader::parse(is);
-    if (!frame_hdr) {
-      return std::nullopt;
+  FrameContext ctx{.channels = channels_,
+                   .sample_rate = sample_rate_,
+                   .file_samples = sample_count_,
+                   .first_sample = next_sample_,
+                   .last = data_.size() - pos_ == size};
+  if constexpr (V == Validation::Strict) {
+    // Every frame before this one is full, so it starts where that many full
+    // frames end.
+    auto const full = frame_size(channels_, kSlicesPerFrame);
+    if (next_sample_ % kFrameLen != 0 ||
+        pos_ - kFileHeaderSize != next_sample_ / kFrameLen * full) {
+      error_ = true;
+      return false;
     }
-    last_frame = frame_hdr.value();
-    if (!channel_count) {
-      channel_count = frame_hdr->channel_count;
-    } else if (channel_count != frame_hdr->channel_count) {
-      return std::nullopt;
+  }
+
+  if (!frame_consistent<V>(hdr, ctx)) {
+    error_ = true;
+    return false;
+  }
+
+  next_sample_ += hdr.sample_count;
+
+  pos_ += kFrameHeaderSize;
+  for (std::size_t ch = 0; ch < channels_; ++ch) {
+    lms_[ch] = parse_lms_state(&data_[pos_]);
+    pos_ += kLmsStateSize;
+  }
+
+  frame_samples_left_ = hdr.sample_count;
+  frame_silent_ = skip_silence_ && is_silent(std::span{lms_}.first(channels_),
+                                             &data_[pos_], slices * channels_);
+  return true;
+}
+
+std::size_t Decoder::next_slices(std::int16_t *out,
+                                 std::size_t max_samples) noexcept {
+  auto n = std::min<std::size_t>(frame_samples_left_, max_samples);
+  // Stop on a slice boundary unless this is the end of the frame.
+  if (n < frame_samples_left_) {
+    n -= n % kSliceLen;
+  }
+
+  if (frame_silent_) {
+    fill_silence(std::span{lms_}.first(channels_), n, out);
+  } else {
+    decode_slices_(std::span{lms_}.first(channels_), &data_[pos_], n, out);
+  }
+  if (stats_ != nullptr) {
+    accumulate_stats(*stats_, out, n, channels_);
+  }
+  pos_ += kSliceSize * channels_ * ((n + kSliceLen - 1) / kSliceLen);
+  frame_samples_left_ -= static_cast<std::uint32_t>(n);
+  return n;
+}
+
+std::size_t Decoder::drain_slice_buffer(std::int16_t *out,
+                                        std::size_t max) noexcept {
+  auto const n = std::min(max, slice_buffer_len_ - slice_buffer_pos_);
+  std::copy_n(&slice_buffer_[slice_buffer_pos_ * channels_], n * channels_,
+              out);
+  slice_buffer_pos_ += n;
+  return n;
+}
+
+std::size_t Decoder::decode(std::span<std::int16_t> out) noexcept {
+  auto const wanted = out.size() / channels_;
+  auto written = drain_slice_buffer(out.data(), wanted);
+  while (written < wanted) {
+    if (frame_samples_left_ == 0 && !next_frame()) {
+      break;
     }
 
-    std::vector<LmsState> lms_state{};
-    for (std::uint8_t ch = 0; ch < *channel_count; ++ch) {
-      auto lms = LmsState::parse(is);
-      if (!lms) {
-        return std::nullopt;
-      }
-      lms_state.push_back(*std::move(lms));
-    }
-
-    // assert(frame_hdr->sample_count % 20 == 0);
-    for (std::uint16_t i = 0; i < frame_hdr->sample_count / 20; ++i) {
-      for (std::uint8_t ch = 0; ch < *channel_count; ++ch) {
-        std::uint64_t slice{};
-        if (!is.read(reinterpret_cast<char *>(&slice), sizeof(slice))) {
-          return std::nullopt;
-        }
-
-        slice = util::net_pack(slice);
-
-        std::uint8_t sf_quant{};
-        std::array<std::int16_t, 20> residuals{};
-        // scale_factor = slice & 0b0000'1111;
-        // slice >>= 4;
-        int offset = 4;
-        sf_quant = static_cast<uint8_t>(slice >> (64 - offset));
-
-        // [1] Dequantize scale factor.
-        int16_t scale_factor = static_cast<std::int16_t>(
-            std::round(std::pow(sf_quant + 1, 2.75f)));
-
-        for (auto &residual : residuals) {
-          // residual = slice & 0b0000'0111;
-          // slice >>= 3;
-          offset += 3;
-          residual = (slice >> (64 - offset)) & 0b111;
-          // [3] Multiply with scale factor, round to nearest, tie away from 0.
-          double r_d =
-              static_cast<double>(scale_factor * kDequantTable.at(residual));
-          int r = r_d < 0 ? static_cast<int>(std::ceil(r_d - 0.5))
-                          : static_cast<int>(std::floor(r_d + 0.5));
-
-          // [4] The predicted sample is the sum of history[n] * weight[n]
-          // >>= 13.
-          auto &lms = lms_state.at(ch);
-          int16_t p = [&] {
-            return (lms.history[0] * lms.weights[0] +
-                    lms.history[1] * lms.weights[1] +
-                    lms.history[2] * lms.weights[2] +
-                    lms.history[3] * lms.weights[3]) >>
-                   13;
-          }();
-
-          // [5] The final sample is p + r, clamped to the signed 16-bit range.
-          output[ch].push_back(
-              static_cast<std::int16_t>(std::clamp(r + p, -32768, 32767)));
-
-          // [6] The LMS weights are updated using the quantized and
-          // scaled residual r, right-shifted by 4 bits.
-          int16_t delta = r >> 4;
-          for (std::size_t j = 0; j < 4; ++j) {
-            lms.weights[j] +=
-                static_cast<std::int16_t>(lms.history[j] < 0 ? -delta : delta);
-          }
-          for (std::size_t j = 0; j < 3; ++j) {
-            lms.history[j] = lms.history[j + 1];
-          }
-          lms.history[3] = output[ch].back();
-        }
-      }
+    // Slices that don't fit go through the slice buffer so the caller can
+    // ask for any number of samples.
+    if (wanted - written < kSliceLen) {
+      slice_buffer_len_ = next_slices(slice_buffer_.data(), kSliceLen);
+      slice_buffer_pos_ = 0;
+      written +=
+          drain_slice_buffer(&out[written * channels_], wanted - written);
+    } else {
+      written += next_slices(&out[written * channels_], wanted - written);
+    }
+  }
+
+  return written;
+}
+
+std::size_t Decoder::decode_frame(std::span<std::int16_t> out) noexcept {
+  if (out.size() < kFrameLen * channels_) {
+    return 0;
+  }
+
+  auto written = drain_slice_buffer(out.data(), kFrameLen);
+  if (written == 0 && frame_samples_left_ == 0 && !next_frame()) {
+    return 0;
+  }
+
+  written += next_slices(&out[written * channels_], frame_samples_left_);
+
+  return written;
+}
+
+std::uint32_t Decoder::skip_frame() noexcept {
+  if (frame_samples_left_ == 0 && !next_frame()) {
+    return 0;
+  }
+
+  auto const skipped = frame_samples_left_;
+  auto const slices = (skipped + kSliceLen - 1) / kSliceLen;
+  pos_ += kSliceSize * slices * channels_;
+  frame_samples_left_ = 0;
+  slice_buffer_len_ = slice_buffer_pos_ = 0;
+  return skipped;
+}
+
+std::optional<FrameIndex> index_frames(std::span<std::uint8_t const> data,
+                                       DecodeOptions const &options) {
+  auto decoder = Decoder::parse(data, options);
+  if (!decoder) {
+    return std::nullopt;
+  }
+
+  FrameIndex index{.sample_rate = decoder->sample_rate(),
+                   .nbr_channels = decoder->nbr_channels(),
+                   .frames = {},
+                   .end = decoder->tell()};
+  std::uint64_t samples = 0;
+  while (auto const n = decoder->skip_frame()) {
+    index.frames.push_back(
+        {.offset = index.end, .first_sample = samples, .sample_count = n});
+    samples += n;
+    index.end = decoder->tell();
+  }
+
+  if (decoder->error()) {
+    return std::nullopt;
+  }
+
+  return index;
+}
+
+// Every frame is read with a single call, together with the header of the
+// frame after it, so the frame's size is known before reading it and the
+// stream is never asked for less than a frame at a time.
+struct StreamDecoder::Buffers {
+  alignas(64) std::array<std::uint8_t, frame_size(kMaxChannels,
+                                                   kSlicesPerFrame) +
+                                            kFrameHeaderSize>
+      bytes;
+  alignas(64) std::array<std::int16_t, kFrameLen * kMaxChannels> samples;
+};
+
+StreamDecoder::StreamDecoder(StreamDecoder &&) noexcept = default;
+StreamDecoder &StreamDecoder::operator=(StreamDecoder &&) noexcept = default;
+StreamDecoder::~StreamDecoder() = default;
+
+std::optional<StreamDecoder>
+StreamDecoder::parse(std::istream &is, DecodeOptions const &options) {
+  StreamDecoder d;
+  d.is_ = &is;
+  d.buffers_ = std::make_unique<Buffers>();
+  d.options_ = options;
+  auto *const data = d.buffers_->bytes.data();
+  constexpr std::size_t kHeadersSize = kFileHeaderSize + kFrameHeaderSize;
+  if (d.read(data, kHeadersSize) != kHeadersSize ||
+      !std::equal(data, data + 4, "qoaf")) {
+    return std::nullopt;
+  }
+
+  auto const first_frame = FrameHeader::parse(data + kFileHeaderSize);
+  auto const sample_count = load_be<std::uint32_t>(data + 4);
+  if (first_frame.channel_count == 0 ||
+      first_frame.channel_count > kMaxChannels ||
+      !options.allows(sample_count, first_frame.channel_count)) {
+    return std::nullopt;
+  }
+
+  d.sample_count_ = sample_count;
+  d.sample_rate_ = first_frame.sample_rate;
+  d.channels_ = first_frame.channel_count;
+  // frames() expects the next frame's header at the start of the buffer.
+  std::memmove(data, data + kFileHeaderSize, kFrameHeaderSize);
+  return d;
+}
+
+std::size_t StreamDecoder::read(std::uint8_t *dst, std::size_t n) {
+  is_->read(reinterpret_cast<char *>(dst), static_cast<std::streamsize>(n));
+  return static_cast<std::size_t>(is_->gcount());
+}
+
+Generator<std::span<std::int16_t const>> StreamDecoder::frames() {
+  switch (options_.validation) {
+  case Validation::Trusted:
+    return decode_frames<Validation::Trusted>();
+  case Validation::Strict:
+    return decode_frames<Validation::Strict>();
+  default:
+    return decode_frames<Validation::Frame>();
+  }
+}
+
+template <Validation V>
+Generator<std::span<std::int16_t const>> StreamDecoder::decode_frames() {
+  auto const channels = std::size_t{channels_};
+  auto const decode_frame_slices = select_decode_slices(channels);
+  auto *const data = buffers_->bytes.data();
+  auto *const out = buffers_->samples.data();
+  std::array<LmsState, kMaxChannels> lms_state{};
+  std::uint64_t decoded = 0;
+  while (true) {
+    auto const hdr = FrameHeader::parse(data);
+    auto const slices = (hdr.sample_count + kSliceLen - 1) / kSliceLen;
+    auto const size = frame_size(channels, slices);
+    if (!frame_decodable(hdr) ||
+        !options_.allows(decoded + hdr.sample_count, channels_)) {
+      error_ = true;
+      co_return;
     }
+
+    auto const body_size = size - kFrameHeaderSize;
+    auto const got =
+        read(data + kFrameHeaderSize, body_size + kFrameHeaderSize);
+    // No next header means this is the last frame.
+    auto const last = got < body_size + kFrameHeaderSize;
+    // Strict requires the last frame to end the stream, without even part
+    // of a header after it.
+    if (got < body_size ||
+        (V == Validation::Strict && last && got != body_size) ||
+        !frame_consistent<V>(hdr, {.channels = channels_,
+                                   .sample_rate = sample_rate_,
+                                   .file_samples = sample_count_,
+                                   .first_sample = decoded,
+                                   .last = last})) {
+      error_ = true;
+      co_return;
+    }
+
+    auto const *lms_data = data + kFrameHeaderSize;
+    for (std::size_t ch = 0; ch < channels; ++ch) {
+      lms_state[ch] = parse_lms_state(lms_data + kLmsStateSize * ch);
+    }
+
+    auto const lms = std::span{lms_state}.first(channels);
+    auto const *slice_data = lms_data + kLmsStateSize * channels;
+    if (options_.skip_silence &&
+        is_silent(lms, slice_data, slices * channels)) {
+      fill_silence(lms, hdr.sample_count, out);
+    } else {
+      decode_frame_slices(lms, slice_data, hdr.sample_count, out);
+    }
+    if (options_.stats != nullptr) {
+      accumulate_stats(*options_.stats, out, hdr.sample_count, channels);
+    }
+
+    co_yield std::span<std::int16_t const>{out, hdr.sample_count * channels};
+
+    // Anything past the samples the file header promised isn't part of the
+    // file, unless it's being checked for, which happened above.
+    decoded += hdr.sample_count;
+    if (last || (sample_count_ != 0 && decoded >= sample_count_)) {
+      co_return;
+    }
+
+    std::memmove(data, data + size, kFrameHeaderSize);
   }
-  std::vector<int16_t> output_interleaved;
-  for (uint32_t i = 0; i < output[0].size(); i++) {
-    output_interleaved.push_back(output[0][i]);
-    if (*channel_count == 2) {
-      output_interleaved.push_back(output[1][i]);
+}
+
+void advance_lms(LmsState &lms, std::int16_t sample) {
+  int const residual = sample - predict(lms);
+  update(lms, sample, residual);
+}
+
+std::vector<std::uint8_t> encode_frame(std::span<std::int16_t const> samples,
+                                       std::uint32_t sample_rate,
+                                       std::span<LmsState> lms) {
+  auto const channels = lms.size();
+  auto const n = std::min(samples.size() / channels, kFrameLen);
+  auto const slices = (n + kSliceLen - 1) / kSliceLen;
+  std::vector<std::uint8_t> out;
+  out.reserve(frame_size(channels, slices));
+
+  append_frame_header(out, sample_rate, n, lms);
+
+  std::array<int, kMaxChannels> prev_sf{};
+  for (std::size_t first = 0; first < n; first += kSliceLen) {
+    auto const len = std::min(kSliceLen, n - first);
+    for (std::size_t ch = 0; ch < channels; ++ch) {
+      append_be(out, encode_slice(lms[ch], prev_sf[ch],
+                                  &samples[first * channels + ch], len,
+                                  channels));
     }
   }
 
-  std::cerr << "Samples read: " << output_interleaved.size() << '\n';
-  return Qoa{.audio_frames = std::move(output_interleaved),
-             .sample_rate = last_frame.sample_rate,
-             .nbr_channels = last_frame.channel_count};
+  return out;
+}
+
+void Decoder::seek(std::size_t frame_offset) noexcept {
+  auto const full = frame_size(channels_, kSlicesPerFrame);
+  auto const offset =
+      std::max(frame_offset, kFileHeaderSize) - kFileHeaderSize;
+  seek(frame_offset, offset / full * kFrameLen);
+}
+
+void Decoder::seek(std::size_t frame_offset,
+                   std::uint64_t first_sample) noexcept {
+  pos_ = std::min(frame_offset, data_.size());
+  next_sample_ = first_sample;
+  frame_samples_left_ = 0;
+  slice_buffer_len_ = slice_buffer_pos_ = 0;
+  error_ = false;
 }
 
 } // namespace qoa
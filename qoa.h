@@ -5,23 +5,314 @@
 #ifndef AUDIO_QOA_H_
 #define AUDIO_QOA_H_
 
+#include "qoa_generator.h"
+
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <vector>
 
 namespace qoa {
 
-class Qoa {
+inline constexpr std::size_t kSliceLen = 20;
+inline constexpr std::size_t kSlicesPerFrame = 256;
+inline constexpr std::size_t kFrameLen = kSliceLen * kSlicesPerFrame;
+inline constexpr std::size_t kMaxChannels = 8;
+inline constexpr int kSilenceThreshold = 64;
+
+struct LmsState {
+    std::array<int, 4> history{};
+    std::array<int, 4> weights{};
+};
+
+// Per-channel statistics over everything decoded.
+struct DecodeStats {
+    struct Channel {
+        // Largest absolute sample value, 32768 for a sample of -32768.
+        int peak{};
+        // Samples at either end of the 16-bit range, where the decoder clamps.
+        std::uint64_t clipped{};
+        std::int64_t sum{};
+        std::uint64_t sum_of_squares{};
+    };
+
+    // Samples per channel.
+    std::uint64_t samples{};
+    std::array<Channel, kMaxChannels> channels{};
+
+    double rms(std::size_t channel) const;
+    double dc_offset(std::size_t channel) const;
+};
+
+// How much of a file is checked while decoding it.
+enum class Validation {
+    // Only what decoding needs to stay within the data and the output is
+    // checked. Frames that contradict each other or the file header decode
+    // to garbage instead of failing.
+    Trusted,
+    // Every frame's header is checked against the file's channel count and
+    // against the frame's own sample count and size, and has to have a
+    // sample rate, which the spec says is 1-16777215 Hz.
+    Frame,
+    // The file is also checked as a whole: every frame has the same sample
+    // rate, every frame but the last is full, the frames add up to the file
+    // header's sample count, and nothing follows them.
+    Strict,
+};
+
+struct DecodeOptions {
+    // If set, every decoded frame is also added to these statistics while
+    // it's still in cache, instead of in another pass over the output.
+    DecodeStats *stats{};
+
+    // Fill frames that are practically silent with their last sample before
+    // the frame instead of decoding them. A frame counts as silent if every
+    // slice uses the smallest scale factor, so no residual is over +-7, and
+    // the history it starts from is within +-kSilenceThreshold. The filled
+    // samples are an approximation, usually a few LSBs off. Every frame
+    // starts from its own LmsState, so the frames after it decode exactly as
+    // they would have.
+    bool skip_silence{};
+
+    Validation validation{Validation::Frame};
+
+    // Limits for decoding untrusted files, which fail to decode as soon as
+    // they'd go past any of them: by announcing more in the file header, by
+    // having more frames than announced, or for streams, which don't
+    // announce anything, by going on for too long.
+    std::uint32_t max_channels{kMaxChannels};
+    // Samples per channel, 0 meaning no limit.
+    std::uint64_t max_samples{};
+    // Bytes of decoded samples, 0 meaning no limit. The decoders' own state
+    // is a fixed size.
+    std::size_t max_memory{};
+
+    // Whether `samples` samples per channel of `channels` channels are within
+    // the limits.
+    bool allows(std::uint64_t samples, std::uint32_t channels) const;
+    // The most samples per channel of `channels` channels that max_samples
+    // and max_memory allow.
+    std::uint64_t sample_limit(std::uint32_t channels) const;
+};
+
+// A fully decoded file. The allocator is only used for audio_frames, which
+// is what's worth putting somewhere else, e.g. qoa::pmr::Qoa decoding into a
+// std::pmr::monotonic_buffer_resource that's released all at once.
+//
+// Instantiated for std::allocator and std::pmr::polymorphic_allocator.
+template <typename Allocator = std::allocator<std::int16_t>>
+class BasicQoa {
 public:
-    static std::optional<Qoa> parse(std::istream &);
-    static std::optional<Qoa> parse(std::istream &&is) { return parse(is); }
+    using allocator_type = Allocator;
+
+    static std::optional<BasicQoa> parse(std::istream &, DecodeOptions const & = {}, Allocator const & = {});
+    static std::optional<BasicQoa> parse(
+            std::istream &&is, DecodeOptions const &options = {}, Allocator const &alloc = {}) {
+        return parse(is, options, alloc);
+    }
+    static std::optional<BasicQoa> parse(
+            std::span<std::uint8_t const>, DecodeOptions const & = {}, Allocator const & = {});
 
-    std::vector<std::int16_t> audio_frames{};
+    std::vector<std::int16_t, Allocator> audio_frames{};
     uint32_t sample_rate{};
     uint32_t nbr_channels{};
 };
 
+extern template class BasicQoa<std::allocator<std::int16_t>>;
+extern template class BasicQoa<std::pmr::polymorphic_allocator<std::int16_t>>;
+
+using Qoa = BasicQoa<>;
+
+namespace pmr {
+using Qoa = BasicQoa<std::pmr::polymorphic_allocator<std::int16_t>>;
+} // namespace pmr
+
+// Streaming decoder over a QOA file that's already in memory.
+//
+// Nothing past parse() allocates, locks, or throws, and all state lives in
+// fixed-size members, so decoding is safe to do from a real-time audio
+// callback. Every 20-sample slice costs the same fixed amount of work: one
+// 64-bit load, a branchless unpack, and 20 iterations of the 4-tap LMS
+// predictor, with no data-dependent loops.
+class Decoder {
+public:
+    // The data isn't copied and has to outlive the decoder. Nothing decoded
+    // is kept, so only the file header is checked against the options'
+    // limits.
+    static std::optional<Decoder> parse(std::span<std::uint8_t const>, DecodeOptions const & = {}) noexcept;
+
+    // Total samples per channel according to the file header.
+    std::uint32_t sample_count() const { return sample_count_; }
+    std::uint32_t sample_rate() const { return sample_rate_; }
+    std::uint32_t nbr_channels() const { return channels_; }
+
+    // Set if decoding stopped because of malformed data rather than at the
+    // end of the stream.
+    bool error() const { return error_; }
+
+    // Decodes up to out.size() / nbr_channels() interleaved samples per
+    // channel, returning how many were written. Anything short of that means
+    // the end of the stream was reached, or error().
+    std::size_t decode(std::span<std::int16_t> out) noexcept;
+
+    // Decodes the rest of the current frame, or the next frame if positioned
+    // on a frame boundary. `out` has to hold kFrameLen * nbr_channels()
+    // samples. Returns the samples per channel written, 0 at the end.
+    std::size_t decode_frame(std::span<std::int16_t> out) noexcept;
+
+    // Moves past the rest of the current frame, or the next frame if
+    // positioned on a frame boundary, after checking its header, without
+    // decoding it. Returns the samples per channel skipped, 0 at the end of
+    // the stream or on error().
+    std::uint32_t skip_frame() noexcept;
+
+    // Byte offset into the file of the next thing to be decoded. On a frame
+    // boundary, passing it to seek() later resumes from that frame.
+    std::size_t tell() const { return pos_; }
+    // Decoding stops at the file header's sample count, so the decoder has
+    // to know which sample the frame starts at, e.g. from a FrameIndex.
+    // Without it, the frames before it are taken to be full, as the spec
+    // requires, but files joined by other tools don't always do that.
+    void seek(std::size_t frame_offset) noexcept;
+    void seek(std::size_t frame_offset, std::uint64_t first_sample) noexcept;
+
+    // The predictor state of each channel after the last decoded slice. Not
+    // updated inside frames that DecodeOptions::skip_silence filled.
+    std::span<LmsState const> lms_state() const { return std::span{lms_}.first(channels_); }
+
+    using DecodeSlicesFn = void (*)(std::span<LmsState>, std::uint8_t const *, std::size_t, std::int16_t *);
+
+private:
+    Decoder() = default;
+
+    bool next_frame() noexcept;
+    template <Validation>
+    bool next_frame() noexcept;
+    std::size_t next_slices(std::int16_t *out, std::size_t max_samples) noexcept;
+    std::size_t drain_slice_buffer(std::int16_t *out, std::size_t max) noexcept;
+
+    std::span<std::uint8_t const> data_{};
+    std::size_t pos_{};
+    // Per channel, of the frame after the current one.
+    std::uint64_t next_sample_{};
+    std::uint32_t sample_count_{};
+    std::uint32_t sample_rate_{};
+    std::uint32_t channels_{};
+    std::uint32_t frame_samples_left_{};
+    bool error_{};
+    // Specialized for the file's channel count.
+    DecodeSlicesFn decode_slices_{};
+    DecodeStats *stats_{};
+    bool skip_silence_{};
+    Validation validation_{};
+    // Set for frames skip_silence_ fills instead of decoding.
+    bool frame_silent_{};
+
+    std::array<LmsState, kMaxChannels> lms_{};
+
+    // Holds the tail of a slice that didn't fit in the caller's buffer.
+    std::array<std::int16_t, kSliceLen * kMaxChannels> slice_buffer_{};
+    std::size_t slice_buffer_len_{};
+    std::size_t slice_buffer_pos_{};
+};
+
+// Where every frame of a file is, found by walking the frame headers
+// without decoding anything. Frames decode independently of each other, so
+// this is all it takes to seek straight to one, or to hand them out to
+// different threads.
+struct FrameIndex {
+    struct Frame {
+        // Into the file, for Decoder::seek().
+        std::size_t offset{};
+        // Of the frame's first sample, per channel.
+        std::uint64_t first_sample{};
+        // Per channel.
+        std::uint32_t sample_count{};
+    };
+
+    std::uint32_t sample_rate{};
+    std::uint32_t nbr_channels{};
+    std::vector<Frame> frames{};
+    // Where the last frame ends.
+    std::size_t end{};
+
+    // Where frame i starts, or the frames end for i == frames.size().
+    std::size_t offset(std::size_t i) const { return i < frames.size() ? frames[i].offset : end; }
+    // Per channel, in all frames.
+    std::uint64_t sample_count() const {
+        return frames.empty() ? 0 : frames.back().first_sample + frames.back().sample_count;
+    }
+};
+
+// Returns nullopt if the file or any frame header is malformed, as decided
+// by the options' Validation. Like Decoder::parse(), only the file header is
+// checked against the options' limits.
+std::optional<FrameIndex> index_frames(std::span<std::uint8_t const>, DecodeOptions const & = {});
+
+// Streaming decoder reading a QOA file from a stream one frame at a time,
+// so memory use doesn't depend on the file's length.
+class StreamDecoder {
+public:
+    // Reads the file header and the first frame's header. The stream has to
+    // outlive the decoder.
+    static std::optional<StreamDecoder> parse(std::istream &, DecodeOptions const & = {});
+
+    StreamDecoder(StreamDecoder &&) noexcept;
+    StreamDecoder &operator=(StreamDecoder &&) noexcept;
+    ~StreamDecoder();
+
+    // Total samples per channel according to the file header, 0 if unknown.
+    std::uint32_t sample_count() const { return sample_count_; }
+    std::uint32_t sample_rate() const { return sample_rate_; }
+    std::uint32_t nbr_channels() const { return channels_; }
+
+    // Set if the frames ended because of malformed or truncated data.
+    bool error() const { return error_; }
+
+    // Decodes a frame each time the range is advanced, yielding its
+    // interleaved samples. Every frame is decoded into the same buffer, so a
+    // frame is only valid until the next one is requested. The decoder has to
+    // outlive the range and can only be iterated once.
+    //
+    //   for (auto frame : decoder->frames()) {
+    //       play(frame);
+    //   }
+    Generator<std::span<std::int16_t const>> frames();
+
+private:
+    struct Buffers;
+
+    StreamDecoder() = default;
+
+    std::size_t read(std::uint8_t *dst, std::size_t n);
+    template <Validation>
+    Generator<std::span<std::int16_t const>> decode_frames();
+
+    std::istream *is_{};
+    std::unique_ptr<Buffers> buffers_;
+    std::uint32_t sample_count_{};
+    std::uint32_t sample_rate_{};
+    std::uint32_t channels_{};
+    bool error_{};
+    DecodeOptions options_{};
+};
+
+// Moves the predictor past a sample that's already been decoded. The weights
+// are updated from the residual that reproduces the sample, which is the one
+// the decoder used unless the sample was clamped.
+void advance_lms(LmsState &, std::int16_t sample);
+
+// Encodes up to kFrameLen interleaved samples per channel as a single frame
+// continuing from `lms`, with one state per channel, and leaves `lms` where
+// the frame ends.
+std::vector<std::uint8_t> encode_frame(
+        std::span<std::int16_t const> samples, std::uint32_t sample_rate, std::span<LmsState> lms);
+
 } // namespace qoa
 
 #endif
@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_analysis.h"
+
+#include "qoa.h"
+#include "qoa_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace qoa {
+
+std::optional<Envelope>
+scale_factor_envelope(std::span<std::uint8_t const> data) {
+  auto index = index_frames(data);
+  if (!index) {
+    return std::nullopt;
+  }
+
+  Envelope envelope{.sample_rate = index->sample_rate,
+                    .nbr_channels = index->nbr_channels,
+                    .scale_factors = {}};
+  auto const channels = envelope.nbr_channels;
+  envelope.scale_factors.reserve(
+      (index->end - index->offset(0)) / kSliceSize);
+
+  // The headers have all been checked, so every frame's slices follow its
+  // LMS states.
+  for (auto const &frame : index->frames) {
+    auto const slices = (frame.sample_count + kSliceLen - 1) / kSliceLen;
+    auto const *slice = &data[frame.offset + kFrameHeaderSize +
+                              kLmsStateSize * channels];
+    for (std::size_t i = 0; i < slices * channels; ++i, slice += kSliceSize) {
+      envelope.scale_factors.push_back(
+          static_cast<std::uint16_t>(slice_scale_factor(slice)));
+    }
+  }
+
+  return envelope;
+}
+
+} // namespace qoa
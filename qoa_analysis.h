@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_ANALYSIS_H_
+#define AUDIO_QOA_ANALYSIS_H_
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// Amplitude envelope read straight from the compressed data. Every slice
+// starts with the quantized scale factor the encoder picked for it, which
+// grows with how far the signal strays from what the LMS predictor expects,
+// so it follows loudness closely enough for waveform thumbnails and silence
+// detection without decoding anything.
+struct Envelope {
+    std::uint32_t sample_rate{};
+    std::uint32_t nbr_channels{};
+    // The dequantized scale factor of every slice, interleaved by channel, so
+    // one value per channel every kSliceLen samples. A slice's residuals are
+    // at most 7 times its scale factor.
+    std::vector<std::uint16_t> scale_factors;
+};
+
+// Returns nullopt if the data isn't a valid QOA file.
+std::optional<Envelope> scale_factor_envelope(std::span<std::uint8_t const>);
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,176 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_async.h"
+
+#include "qoa.h"
+#include "qoa_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace qoa {
+namespace {
+
+// Around 80k samples per channel per task, enough for the task overhead not
+// to matter while still splitting a few seconds of audio between threads.
+constexpr std::size_t kFramesPerTask = 16;
+
+struct Job {
+  std::vector<std::uint8_t> source;
+  Executor executor;
+  DecodeOptions options;
+  std::promise<std::optional<Qoa>> promise;
+
+  Qoa qoa;
+  std::vector<FrameIndex::Frame> frames;
+  // One per task, merged when they're all done.
+  std::vector<DecodeStats> stats;
+  // One per task, for whatever it threw.
+  std::vector<std::exception_ptr> errors;
+  std::atomic<bool> failed{};
+  std::atomic<std::size_t> tasks_left{};
+};
+
+void merge_stats(DecodeStats &into, DecodeStats const &from) {
+  into.samples += from.samples;
+  for (std::size_t ch = 0; ch < kMaxChannels; ++ch) {
+    auto &a = into.channels[ch];
+    auto const &b = from.channels[ch];
+    a.peak = std::max(a.peak, b.peak);
+    a.clipped += b.clipped;
+    a.sum += b.sum;
+    a.sum_of_squares += b.sum_of_squares;
+  }
+}
+
+void finish(Job &job) {
+  for (auto const &error : job.errors) {
+    if (error) {
+      job.promise.set_exception(error);
+      return;
+    }
+  }
+
+  if (job.failed) {
+    job.promise.set_value(std::nullopt);
+    return;
+  }
+
+  if (job.options.stats != nullptr) {
+    for (auto const &s : job.stats) {
+      merge_stats(*job.options.stats, s);
+    }
+  }
+
+  job.promise.set_value(std::move(job.qoa));
+}
+
+// Returns false if the run didn't decode in full, e.g. because a frame's
+// slices were cut short.
+bool decode_run(Job &job, std::size_t task) {
+  auto const first = task * kFramesPerTask;
+  auto const last = std::min(first + kFramesPerTask, job.frames.size());
+  auto options = job.options;
+  if (options.stats != nullptr) {
+    options.stats = &job.stats[task];
+  }
+
+  // The headers were all checked while indexing, so this can't fail.
+  auto decoder = *Decoder::parse(job.source, options);
+  auto const channels = job.qoa.nbr_channels;
+  auto const start = job.frames[first].first_sample;
+  auto const end =
+      job.frames[last - 1].first_sample + job.frames[last - 1].sample_count;
+  decoder.seek(job.frames[first].offset, start);
+  auto const decoded = decoder.decode(std::span{job.qoa.audio_frames}.subspan(
+      start * channels, (end - start) * channels));
+  return decoded == end - start && !decoder.error();
+}
+
+// Whichever run finishes last completes the future, so every task gets
+// here, and nothing it throws may leave it: on a ThreadPool thread that
+// would end the process.
+void run_task(Job &job, std::size_t task) {
+  try {
+    if (!decode_run(job, task)) {
+      job.failed = true;
+    }
+  } catch (...) {
+    job.errors[task] = std::current_exception();
+  }
+
+  if (--job.tasks_left == 0) {
+    finish(job);
+  }
+}
+
+void index_and_split(std::shared_ptr<Job> const &job) {
+  auto index = index_frames(job->source, job->options);
+  if (!index || !job->options.allows(index->sample_count(),
+                                     index->nbr_channels)) {
+    job->promise.set_value(std::nullopt);
+    return;
+  }
+
+  auto const channels = index->nbr_channels;
+  job->qoa = Qoa{.audio_frames = std::vector<std::int16_t>(
+                     index->sample_count() * channels),
+                 .sample_rate = index->sample_rate,
+                 .nbr_channels = channels};
+  job->frames = std::move(index->frames);
+  auto const tasks = (job->frames.size() + kFramesPerTask - 1) / kFramesPerTask;
+  if (tasks == 0) {
+    finish(*job);
+    return;
+  }
+
+  job->stats.resize(tasks);
+  job->errors.resize(tasks);
+  job->tasks_left = tasks;
+  for (std::size_t task = 0; task < tasks; ++task) {
+    job->executor([job, task] { run_task(*job, task); });
+  }
+}
+
+} // namespace
+
+std::future<std::optional<Qoa>> async_decode(std::vector<std::uint8_t> source,
+                                             Executor executor,
+                                             DecodeOptions const &options) {
+  auto job = std::make_shared<Job>();
+  job->source = std::move(source);
+  job->executor = std::move(executor);
+  job->options = options;
+  auto future = job->promise.get_future();
+  job->executor([job] {
+    try {
+      index_and_split(job);
+    } catch (...) {
+      job->promise.set_exception(std::current_exception());
+    }
+  });
+  return future;
+}
+
+std::future<std::optional<Qoa>> async_decode(std::vector<std::uint8_t> source,
+                                             ThreadPool &pool,
+                                             DecodeOptions const &options) {
+  return async_decode(
+      std::move(source),
+      [&pool](std::function<void()> task) { pool.submit(std::move(task)); },
+      options);
+}
+
+} // namespace qoa
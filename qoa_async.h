@@ -0,0 +1,43 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_ASYNC_H_
+#define AUDIO_QOA_ASYNC_H_
+
+#include "qoa.h"
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <optional>
+#include <vector>
+
+namespace qoa {
+
+class ThreadPool;
+
+// Runs a task at some point, on whatever thread it likes. Running it right
+// away on the calling thread is fine too.
+using Executor = std::function<void(std::function<void()>)>;
+
+// Decodes the file as tasks on `executor`, without blocking the calling
+// thread or any of the executor's threads while waiting for each other.
+//
+// One task walks the frame headers and sizes the output, then hands out runs
+// of frames to decode straight into their place in it, which works because
+// every frame starts from its own LmsState. Whichever run finishes last
+// completes the future, with the same result Qoa::parse would have given:
+// nullopt if any run couldn't decode all of its frames. Anything a task
+// throws, like std::bad_alloc, is passed on through the future.
+//
+// DecodeOptions::stats, if set, is only written to once all frames are done,
+// right before the future is ready.
+std::future<std::optional<Qoa>> async_decode(
+        std::vector<std::uint8_t> source, Executor executor, DecodeOptions const & = {});
+std::future<std::optional<Qoa>> async_decode(
+        std::vector<std::uint8_t> source, ThreadPool &, DecodeOptions const & = {});
+
+} // namespace qoa
+
+#endif
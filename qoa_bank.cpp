@@ -0,0 +1,324 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_bank.h"
+
+#include "qoa.h"
+#include "qoa_endian.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace qoa {
+namespace {
+
+constexpr std::array<std::uint8_t, 4> kMagic{'q', 'o', 'a', 'b'};
+constexpr std::uint32_t kVersion = 2;
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kEntrySize = 64;
+constexpr std::size_t kFrameSize = 8;
+
+void store_entry(std::uint8_t *data, Bank::Entry const &e) {
+  store_le(data, e.name_hash);
+  store_le(data + 8, e.name_offset);
+  store_le(data + 16, e.offset);
+  store_le(data + 24, e.size);
+  store_le(data + 32, e.frame_table_offset);
+  store_le(data + 40, e.name_size);
+  store_le(data + 44, e.frame_count);
+  store_le(data + 48, e.sample_count);
+  store_le(data + 52, e.sample_rate);
+  store_le(data + 56, e.nbr_channels);
+  store_le(data + 60, e.reserved);
+}
+
+constexpr std::size_t align8(std::size_t n) {
+  return (n + 7) & ~std::size_t{7};
+}
+
+// Unmaps memory mapped by Bank::open.
+void unmap(void *mapping, [[maybe_unused]] std::size_t size) {
+  if (mapping == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(mapping);
+#else
+  munmap(mapping, size);
+#endif
+}
+
+} // namespace
+
+std::optional<std::vector<std::uint8_t>>
+Bank::build(std::span<Input const> inputs) {
+  struct Item {
+    Input const *input{};
+    Entry entry{};
+    std::vector<Frame> frames;
+  };
+
+  std::vector<Item> items;
+  for (auto const &input : inputs) {
+    auto index = index_frames(input.data);
+    if (!index) {
+      return std::nullopt;
+    }
+
+    Item item{.input = &input};
+    item.frames.reserve(index->frames.size());
+    for (auto const &frame : index->frames) {
+      item.frames.push_back({
+          .offset = static_cast<std::uint32_t>(frame.offset),
+          .first_sample = static_cast<std::uint32_t>(frame.first_sample),
+      });
+    }
+
+    item.entry = Entry{
+        .name_hash = hash(input.name),
+        .size = input.data.size(),
+        .name_size = static_cast<std::uint32_t>(input.name.size()),
+        .frame_count = static_cast<std::uint32_t>(item.frames.size()),
+        .sample_count = static_cast<std::uint32_t>(index->sample_count()),
+        .sample_rate = index->sample_rate,
+        .nbr_channels = index->nbr_channels,
+    };
+    items.push_back(std::move(item));
+  }
+
+  std::ranges::sort(items, {}, [](Item const &i) { return i.entry.name_hash; });
+  if (std::ranges::adjacent_find(items, {}, [](Item const &i) {
+        return i.entry.name_hash;
+      }) != items.end()) {
+    return std::nullopt;
+  }
+
+  std::size_t size = kHeaderSize + kEntrySize * items.size();
+  for (auto &item : items) {
+    item.entry.frame_table_offset = size;
+    size += kFrameSize * item.frames.size();
+  }
+  for (auto &item : items) {
+    item.entry.name_offset = size;
+    size += item.entry.name_size;
+  }
+  for (auto &item : items) {
+    size = align8(size);
+    item.entry.offset = size;
+    size += item.entry.size;
+  }
+
+  std::vector<std::uint8_t> bank(size);
+  std::ranges::copy(kMagic, bank.begin());
+  store_le(&bank[4], kVersion);
+  store_le(&bank[8], static_cast<std::uint32_t>(items.size()));
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    auto const &[input, entry, frames] = items[i];
+    store_entry(&bank[kHeaderSize + kEntrySize * i], entry);
+    for (std::size_t f = 0; f < frames.size(); ++f) {
+      auto *data = &bank[entry.frame_table_offset + kFrameSize * f];
+      store_le(data, frames[f].offset);
+      store_le(data + 4, frames[f].first_sample);
+    }
+    std::ranges::copy(input->name, &bank[entry.name_offset]);
+    std::ranges::copy(input->data, &bank[entry.offset]);
+  }
+
+  return bank;
+}
+
+std::optional<Bank> Bank::open(char const *path) {
+  void *mapping{};
+  std::size_t size{};
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+
+  LARGE_INTEGER file_size{};
+  HANDLE file_mapping =
+      GetFileSizeEx(file, &file_size)
+          ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)
+          : nullptr;
+  CloseHandle(file);
+  if (file_mapping == nullptr) {
+    return std::nullopt;
+  }
+
+  // The view keeps the mapping alive on its own.
+  mapping = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(file_mapping);
+  size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat st {};
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size = static_cast<std::size_t>(st.st_size);
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      mapping = nullptr;
+    }
+  }
+  ::close(fd);
+#endif
+  if (mapping == nullptr) {
+    return std::nullopt;
+  }
+
+  auto bank = parse({static_cast<std::uint8_t const *>(mapping), size});
+  if (!bank) {
+    unmap(mapping, size);
+    return std::nullopt;
+  }
+
+  bank->mapping_ = mapping;
+  bank->mapping_size_ = size;
+  return bank;
+}
+
+std::optional<Bank> Bank::parse(std::span<std::uint8_t const> data) {
+  if (data.size() < kHeaderSize ||
+      !std::ranges::equal(data.first(kMagic.size()), kMagic) ||
+      load_le<std::uint32_t>(&data[4]) != kVersion) {
+    return std::nullopt;
+  }
+
+  auto const entry_count = load_le<std::uint32_t>(&data[8]);
+  if ((data.size() - kHeaderSize) / kEntrySize < entry_count) {
+    return std::nullopt;
+  }
+
+  Bank bank;
+  bank.bytes_ = data;
+  bank.entry_count_ = entry_count;
+  return bank;
+}
+
+Bank::Bank(Bank &&other) noexcept
+    : bytes_{std::exchange(other.bytes_, {})},
+      entry_count_{std::exchange(other.entry_count_, 0)},
+      mapping_{std::exchange(other.mapping_, nullptr)},
+      mapping_size_{std::exchange(other.mapping_size_, 0)} {}
+
+Bank &Bank::operator=(Bank &&other) noexcept {
+  if (this != &other) {
+    unmap(mapping_, mapping_size_);
+    bytes_ = std::exchange(other.bytes_, {});
+    entry_count_ = std::exchange(other.entry_count_, 0);
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    mapping_size_ = std::exchange(other.mapping_size_, 0);
+  }
+  return *this;
+}
+
+Bank::~Bank() { unmap(mapping_, mapping_size_); }
+
+std::optional<Bank::Entry> Bank::entry(std::size_t i) const {
+  if (i >= entry_count_) {
+    return std::nullopt;
+  }
+
+  auto const *data = &bytes_[kHeaderSize + kEntrySize * i];
+  return Entry{
+      .name_hash = load_le<std::uint64_t>(data),
+      .name_offset = load_le<std::uint64_t>(data + 8),
+      .offset = load_le<std::uint64_t>(data + 16),
+      .size = load_le<std::uint64_t>(data + 24),
+      .frame_table_offset = load_le<std::uint64_t>(data + 32),
+      .name_size = load_le<std::uint32_t>(data + 40),
+      .frame_count = load_le<std::uint32_t>(data + 44),
+      .sample_count = load_le<std::uint32_t>(data + 48),
+      .sample_rate = load_le<std::uint32_t>(data + 52),
+      .nbr_channels = load_le<std::uint32_t>(data + 56),
+      .reserved = load_le<std::uint32_t>(data + 60),
+  };
+}
+
+std::uint64_t Bank::entry_hash(std::size_t i) const {
+  return load_le<std::uint64_t>(&bytes_[kHeaderSize + kEntrySize * i]);
+}
+
+std::optional<Bank::Entry> Bank::find(std::string_view name) const {
+  auto const h = hash(name);
+  std::size_t lo = 0;
+  std::size_t hi = entry_count_;
+  while (lo < hi) {
+    auto const mid = lo + (hi - lo) / 2;
+    if (entry_hash(mid) < h) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == entry_count_ || entry_hash(lo) != h) {
+    return std::nullopt;
+  }
+
+  auto e = entry(lo);
+  if (this->name(*e) != name) {
+    return std::nullopt;
+  }
+
+  return e;
+}
+
+// The accessors below check the offsets they're given so that a damaged bank
+// gives back empty results rather than reading out of bounds.
+std::string_view Bank::name(Entry const &e) const {
+  if (e.name_offset > bytes_.size() ||
+      bytes_.size() - e.name_offset < e.name_size) {
+    return {};
+  }
+
+  return {reinterpret_cast<char const *>(&bytes_[e.name_offset]), e.name_size};
+}
+
+std::span<std::uint8_t const> Bank::data(Entry const &e) const {
+  if (e.offset > bytes_.size() || bytes_.size() - e.offset < e.size) {
+    return {};
+  }
+
+  return bytes_.subspan(e.offset, e.size);
+}
+
+std::optional<Bank::Frame> Bank::frame(Entry const &e,
+                                       std::size_t frame_idx) const {
+  if (frame_idx >= e.frame_count || e.frame_table_offset > bytes_.size() ||
+      (bytes_.size() - e.frame_table_offset) / kFrameSize <= frame_idx) {
+    return std::nullopt;
+  }
+
+  auto const *data = &bytes_[e.frame_table_offset + kFrameSize * frame_idx];
+  return Frame{
+      .offset = load_le<std::uint32_t>(data),
+      .first_sample = load_le<std::uint32_t>(data + 4),
+  };
+}
+
+} // namespace qoa
@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_BANK_H_
+#define AUDIO_QOA_BANK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace qoa {
+
+// A single file holding many QOA streams behind a fixed-layout index that's
+// used in place, so opening a bank is one mmap and a header check.
+//
+// Layout, all integers little-endian:
+//   header   "qoab", u32 version, u32 entry count, u32 reserved
+//   entries  Bank::Entry, sorted by name hash
+//   tables   per entry: Bank::Frame of every frame in its stream
+//   names    entry names, not terminated
+//   streams  the QOA files, each aligned to 8 bytes
+class Bank {
+public:
+    struct Entry {
+        std::uint64_t name_hash{};
+        std::uint64_t name_offset{};
+        std::uint64_t offset{};
+        std::uint64_t size{};
+        std::uint64_t frame_table_offset{};
+        std::uint32_t name_size{};
+        std::uint32_t frame_count{};
+        std::uint32_t sample_count{};
+        std::uint32_t sample_rate{};
+        std::uint32_t nbr_channels{};
+        std::uint32_t reserved{};
+    };
+
+    // Where a frame starts in its stream, for Decoder::seek().
+    struct Frame {
+        std::uint32_t offset{};
+        // Per channel.
+        std::uint32_t first_sample{};
+    };
+
+    struct Input {
+        std::string name;
+        std::span<std::uint8_t const> data;
+    };
+
+    // FNV-1a.
+    static constexpr std::uint64_t hash(std::string_view name) {
+        std::uint64_t h = 0xcbf2'9ce4'8422'2325;
+        for (char c : name) {
+            h = (h ^ static_cast<std::uint8_t>(c)) * 0x100'0000'01b3;
+        }
+        return h;
+    }
+
+    // Returns nullopt if any input isn't a valid QOA file or two names hash
+    // to the same value.
+    static std::optional<std::vector<std::uint8_t>> build(std::span<Input const>);
+
+    // Maps the file at `path` for as long as the Bank lives.
+    static std::optional<Bank> open(char const *path);
+
+    // Uses `data` in place. It has to outlive the Bank.
+    static std::optional<Bank> parse(std::span<std::uint8_t const> data);
+
+    Bank(Bank &&) noexcept;
+    Bank &operator=(Bank &&) noexcept;
+    ~Bank();
+
+    std::size_t size() const { return entry_count_; }
+    // Returns nullopt if i >= size().
+    std::optional<Entry> entry(std::size_t i) const;
+    std::optional<Entry> find(std::string_view name) const;
+
+    std::string_view name(Entry const &) const;
+    std::span<std::uint8_t const> data(Entry const &) const;
+    // Returns nullopt if frame_idx >= entry.frame_count.
+    std::optional<Frame> frame(Entry const &, std::size_t frame_idx) const;
+
+private:
+    Bank() = default;
+    std::uint64_t entry_hash(std::size_t) const;
+
+    std::span<std::uint8_t const> bytes_{};
+    std::size_t entry_count_{};
+    // Set when the bytes are a mapping owned by the bank.
+    void *mapping_{};
+    std::size_t mapping_size_{};
+};
+
+} // namespace qoa
+
+#endif
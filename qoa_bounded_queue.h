@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_BOUNDED_QUEUE_H_
+#define AUDIO_QOA_BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace qoa {
+
+// Multi-producer, multi-consumer FIFO that blocks producers while it's full,
+// so a slow consumer holds back the stages feeding it.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity_{capacity > 0 ? capacity : 1} {}
+
+    // Returns false, dropping the item, if the queue has been closed.
+    bool push(T item) {
+        std::unique_lock lock{mutex_};
+        not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+
+        items_.push_back(std::move(item));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Returns nullopt once the queue has been closed and drained.
+    std::optional<T> pop() {
+        std::unique_lock lock{mutex_};
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+
+        auto item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return item;
+    }
+
+    // Wakes everyone up. Items already queued can still be popped.
+    void close() {
+        {
+            std::scoped_lock lock{mutex_};
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    std::size_t capacity_{};
+    bool closed_{};
+};
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,154 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_cache.h"
+
+#include "qoa.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace qoa {
+namespace {
+
+std::uint64_t make_key(FrameCache::AssetId asset, std::size_t frame_idx) {
+  return std::uint64_t{asset} << 32 | static_cast<std::uint32_t>(frame_idx);
+}
+
+std::size_t frame_bytes(FrameCache::Frame const &frame) {
+  return frame->size() * sizeof(std::int16_t);
+}
+
+} // namespace
+
+std::optional<FrameCache::AssetId>
+FrameCache::add(std::vector<std::uint8_t> data) {
+  // Only the frame headers are read here, so this is cheap compared to
+  // decoding, and it means a miss can go straight to the frame it needs.
+  auto index = index_frames(data);
+  if (!index) {
+    return std::nullopt;
+  }
+
+  auto const nbr_channels = index->nbr_channels;
+  auto const sample_rate = index->sample_rate;
+  assets_.push_back(Asset{
+      .data = std::move(data),
+      .frames = std::move(index->frames),
+      .nbr_channels = nbr_channels,
+      .sample_rate = sample_rate,
+  });
+  return static_cast<AssetId>(assets_.size() - 1);
+}
+
+std::size_t FrameCache::frame_count(AssetId asset) const {
+  return assets_.at(asset).frames.size();
+}
+
+std::uint32_t FrameCache::nbr_channels(AssetId asset) const {
+  return assets_.at(asset).nbr_channels;
+}
+
+std::uint32_t FrameCache::sample_rate(AssetId asset) const {
+  return assets_.at(asset).sample_rate;
+}
+
+FrameCache::Frame FrameCache::get(AssetId asset, std::size_t frame_idx) {
+  if (asset >= assets_.size() ||
+      frame_idx >= assets_[asset].frames.size()) {
+    return nullptr;
+  }
+
+  auto const key = make_key(asset, frame_idx);
+  if (auto it = index_.find(key); it != index_.end()) {
+    ++stats_.hits;
+    auto &entry = entries_[it->second];
+    entry.referenced = true;
+    return entry.frame;
+  }
+
+  ++stats_.misses;
+  auto frame = decode(assets_[asset], frame_idx);
+  if (frame) {
+    insert(key, frame);
+  }
+
+  return frame;
+}
+
+FrameCache::Frame FrameCache::decode(Asset const &asset,
+                                     std::size_t frame_idx) const {
+  auto decoder = Decoder::parse(asset.data);
+  if (!decoder) {
+    return nullptr;
+  }
+
+  auto const &frame = asset.frames[frame_idx];
+  decoder->seek(frame.offset, frame.first_sample);
+  std::vector<std::int16_t> samples(kFrameLen * asset.nbr_channels);
+  auto const decoded = decoder->decode_frame(samples);
+  if (decoded == 0) {
+    return nullptr;
+  }
+
+  samples.resize(decoded * asset.nbr_channels);
+  return std::make_shared<std::vector<std::int16_t> const>(std::move(samples));
+}
+
+void FrameCache::insert(std::uint64_t key, Frame frame) {
+  auto const bytes = frame_bytes(frame);
+  if (bytes > byte_budget_) {
+    return;
+  }
+
+  while (stats_.bytes + bytes > byte_budget_) {
+    evict_one();
+  }
+
+  // Entries don't move once inserted so the clock hand's sweep order stays
+  // stable. Evicted entries are reused before the table grows.
+  std::size_t slot = entries_.size();
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    entries_.emplace_back();
+  }
+
+  entries_[slot] = Entry{.key = key, .frame = std::move(frame)};
+  index_.emplace(key, slot);
+  stats_.bytes += bytes;
+}
+
+void FrameCache::evict_one() {
+  while (true) {
+    if (clock_hand_ >= entries_.size()) {
+      clock_hand_ = 0;
+    }
+
+    auto &entry = entries_[clock_hand_++];
+    if (!entry.frame) {
+      continue;
+    }
+
+    // Recently used entries get a second chance.
+    if (entry.referenced) {
+      entry.referenced = false;
+      continue;
+    }
+
+    stats_.bytes -= frame_bytes(entry.frame);
+    ++stats_.evictions;
+    index_.erase(entry.key);
+    entry.frame.reset();
+    free_slots_.push_back(clock_hand_ - 1);
+    return;
+  }
+}
+
+} // namespace qoa
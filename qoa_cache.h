@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_CACHE_H_
+#define AUDIO_QOA_CACHE_H_
+
+#include "qoa.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace qoa {
+
+// Keeps QOA assets resident in their compressed form and caches decoded
+// frames up to a byte budget. Frames are evicted using the CLOCK algorithm
+// and decoded again, one frame at a time, when they're asked for later.
+//
+// Not thread-safe.
+class FrameCache {
+public:
+    using AssetId = std::uint32_t;
+    using Frame = std::shared_ptr<std::vector<std::int16_t> const>;
+
+    struct Stats {
+        std::uint64_t hits{};
+        std::uint64_t misses{};
+        std::uint64_t evictions{};
+        std::size_t bytes{};
+    };
+
+    explicit FrameCache(std::size_t byte_budget) : byte_budget_{byte_budget} {}
+
+    // Returns nullopt if the data isn't a valid QOA file.
+    std::optional<AssetId> add(std::vector<std::uint8_t> data);
+
+    std::size_t frame_count(AssetId) const;
+    std::uint32_t nbr_channels(AssetId) const;
+    std::uint32_t sample_rate(AssetId) const;
+
+    // Returns the interleaved samples of the frame, decoding it if it isn't
+    // cached. The frame stays valid after it's evicted for as long as it's
+    // held on to. Returns nullptr if the frame doesn't exist or can't be
+    // decoded.
+    Frame get(AssetId, std::size_t frame_idx);
+
+    Stats const &stats() const { return stats_; }
+
+private:
+    struct Asset {
+        std::vector<std::uint8_t> data;
+        std::vector<FrameIndex::Frame> frames;
+        std::uint32_t nbr_channels{};
+        std::uint32_t sample_rate{};
+    };
+
+    struct Entry {
+        std::uint64_t key{};
+        Frame frame{};
+        bool referenced{};
+    };
+
+    Frame decode(Asset const &, std::size_t frame_idx) const;
+    void insert(std::uint64_t key, Frame);
+    void evict_one();
+
+    std::size_t byte_budget_{};
+    std::vector<Asset> assets_;
+    std::vector<Entry> entries_;
+    std::vector<std::size_t> free_slots_;
+    std::unordered_map<std::uint64_t, std::size_t> index_;
+    std::size_t clock_hand_{};
+    Stats stats_{};
+};
+
+} // namespace qoa
+
+#endif
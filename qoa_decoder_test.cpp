@@ -0,0 +1,306 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every allocation goes through here so the tests can tell when the decoder
+// allocates.
+namespace {
+
+bool allocations_forbidden = false;
+std::size_t forbidden_allocations = 0;
+
+void *allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) {
+    if (allocations_forbidden) {
+        ++forbidden_allocations;
+    }
+
+    size = std::max<std::size_t>(size, 1);
+    auto *p = alignment <= alignof(std::max_align_t)
+            ? std::malloc(size)
+            : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (p == nullptr) {
+        throw std::bad_alloc{};
+    }
+
+    return p;
+}
+
+void *allocate(std::size_t size, std::nothrow_t const &) noexcept {
+    try {
+        return allocate(size);
+    } catch (std::bad_alloc const &) {
+        return nullptr;
+    }
+}
+
+void *allocate(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+    try {
+        return allocate(size, static_cast<std::size_t>(alignment));
+    } catch (std::bad_alloc const &) {
+        return nullptr;
+    }
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    return allocate(size);
+}
+void *operator new[](std::size_t size) {
+    return allocate(size);
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new(std::size_t size, std::nothrow_t const &tag) noexcept {
+    return allocate(size, tag);
+}
+void *operator new[](std::size_t size, std::nothrow_t const &tag) noexcept {
+    return allocate(size, tag);
+}
+void *operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &tag) noexcept {
+    return allocate(size, alignment, tag);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const &tag) noexcept {
+    return allocate(size, alignment, tag);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, std::string_view what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAILED: %.*s\n", static_cast<int>(what.size()), what.data());
+        ++failures;
+    }
+}
+
+// Counts the allocations made while it's alive.
+class ForbidAllocations {
+public:
+    ForbidAllocations() {
+        forbidden_allocations = 0;
+        allocations_forbidden = true;
+    }
+    ~ForbidAllocations() { allocations_forbidden = false; }
+
+    ForbidAllocations(ForbidAllocations const &) = delete;
+    ForbidAllocations &operator=(ForbidAllocations const &) = delete;
+
+    std::size_t count() const { return forbidden_allocations; }
+};
+
+std::optional<std::vector<std::uint8_t>> read_file(char const *path) {
+    std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+    if (!fs) {
+        return std::nullopt;
+    }
+
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>{fs}, {});
+}
+
+// Decodes the whole file with decode() in chunks of `chunk` samples per
+// channel.
+void test_decode_does_not_allocate(std::span<std::uint8_t const> file,
+        qoa::DecodeOptions const &options,
+        std::size_t chunk,
+        std::vector<std::int16_t> const &expected) {
+    auto decoder = qoa::Decoder::parse(file, options);
+    expect(decoder.has_value(), "Decoder::parse");
+    if (!decoder) {
+        return;
+    }
+
+    std::vector<std::int16_t> out(expected.size() + chunk * decoder->nbr_channels());
+    std::size_t samples = 0;
+    std::size_t allocations = 0;
+    {
+        ForbidAllocations forbid;
+        while (true) {
+            auto const n = decoder->decode(std::span{out}.subspan(samples, chunk * decoder->nbr_channels()));
+            samples += n * decoder->nbr_channels();
+            if (n < chunk) {
+                break;
+            }
+        }
+        allocations = forbid.count();
+    }
+
+    expect(allocations == 0, "decode() doesn't allocate");
+    expect(!decoder->error(), "decode() reaches the end without errors");
+    out.resize(samples);
+    expect(options.skip_silence || out == expected, "decode() matches Qoa::parse");
+}
+
+void test_decode_frame_does_not_allocate(std::span<std::uint8_t const> file,
+        qoa::DecodeOptions const &options,
+        std::vector<std::int16_t> const &expected) {
+    auto decoder = qoa::Decoder::parse(file, options);
+    expect(decoder.has_value(), "Decoder::parse");
+    if (!decoder) {
+        return;
+    }
+
+    std::vector<std::int16_t> out(expected.size() + qoa::kFrameLen * decoder->nbr_channels());
+    std::size_t samples = 0;
+    std::size_t allocations = 0;
+    {
+        ForbidAllocations forbid;
+        while (auto const n = decoder->decode_frame(std::span{out}.subspan(samples))) {
+            samples += n * decoder->nbr_channels();
+        }
+        allocations = forbid.count();
+    }
+
+    expect(allocations == 0, "decode_frame() doesn't allocate");
+    expect(!decoder->error(), "decode_frame() reaches the end without errors");
+    out.resize(samples);
+    expect(options.skip_silence || out == expected, "decode_frame() matches Qoa::parse");
+}
+
+std::string_view name(qoa::Validation validation) {
+    switch (validation) {
+    case qoa::Validation::Trusted:
+        return "Trusted";
+    case qoa::Validation::Frame:
+        return "Frame";
+    case qoa::Validation::Strict:
+        return "Strict";
+    }
+    return "?";
+}
+
+// Appends `trailing` bytes to `file`, which Strict rejects and the other
+// validations ignore, the same way through both Qoa::parse() overloads.
+void test_trailing_bytes(std::span<std::uint8_t const> file,
+        qoa::Validation validation,
+        std::size_t trailing,
+        std::vector<std::int16_t> const &expected) {
+    std::vector<std::uint8_t> data(file.begin(), file.end());
+    data.resize(data.size() + trailing, 0xab);
+    auto const accepted = trailing == 0 || validation != qoa::Validation::Strict;
+    auto const what = std::to_string(trailing) + " trailing bytes with Validation::" + std::string{name(validation)};
+
+    qoa::DecodeOptions const options{.validation = validation};
+    auto const from_span = qoa::Qoa::parse(data, options);
+    auto const from_stream = qoa::Qoa::parse(std::istringstream{std::string(data.begin(), data.end())}, options);
+    expect(from_span.has_value() == accepted, "Qoa::parse(span) with " + what);
+    expect(from_stream.has_value() == accepted, "Qoa::parse(istream) with " + what);
+    expect(!from_span || from_span->audio_frames == expected, "Qoa::parse(span) output with " + what);
+    expect(!from_stream || from_stream->audio_frames == expected, "Qoa::parse(istream) output with " + what);
+}
+
+// Zeroes the sample rate in every frame header, which only Trusted lets
+// through.
+void test_zero_sample_rate(std::span<std::uint8_t const> file, qoa::Validation validation) {
+    std::vector<std::uint8_t> data(file.begin(), file.end());
+    for (std::size_t pos = 8; pos + 8 <= data.size();) {
+        data[pos + 1] = data[pos + 2] = data[pos + 3] = 0;
+        pos += static_cast<std::size_t>(data[pos + 6] << 8 | data[pos + 7]);
+    }
+
+    auto const accepted = validation == qoa::Validation::Trusted;
+    auto const what = "sample rate 0 with Validation::" + std::string{name(validation)};
+    qoa::DecodeOptions const options{.validation = validation};
+    expect(qoa::Qoa::parse(data, options).has_value() == accepted, "Qoa::parse(span) with " + what);
+    expect(qoa::Qoa::parse(std::istringstream{std::string(data.begin(), data.end())}, options).has_value() == accepted,
+            "Qoa::parse(istream) with " + what);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: qoa_decoder_test <file.qoa>\n");
+        return EXIT_FAILURE;
+    }
+
+    auto file = read_file(argv[1]);
+    if (!file) {
+        std::fprintf(stderr, "Unable to read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    auto reference = qoa::Qoa::parse(*file);
+    if (!reference) {
+        std::fprintf(stderr, "Unable to decode %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    qoa::DecodeStats stats{};
+    std::vector<qoa::DecodeOptions> const options{
+            {},
+            {.stats = &stats},
+            {.skip_silence = true},
+            {.validation = qoa::Validation::Trusted},
+            {.validation = qoa::Validation::Strict},
+    };
+
+    for (auto const &o : options) {
+        // Chunks that end mid-slice, on slice boundaries and past whole frames.
+        for (std::size_t chunk : {1, 7, 20, 33, 5120, 20000}) {
+            test_decode_does_not_allocate(*file, o, chunk, reference->audio_frames);
+        }
+        test_decode_frame_does_not_allocate(*file, o, reference->audio_frames);
+    }
+
+    // Less than a frame header, and a whole one's worth.
+    for (auto validation : {qoa::Validation::Trusted, qoa::Validation::Frame, qoa::Validation::Strict}) {
+        for (std::size_t trailing : {0, 3, 8}) {
+            test_trailing_bytes(*file, validation, trailing, reference->audio_frames);
+        }
+        test_zero_sample_rate(*file, validation);
+    }
+
+    if (failures != 0) {
+        return EXIT_FAILURE;
+    }
+
+    std::printf("All tests passed\n");
+}
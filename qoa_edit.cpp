@@ -0,0 +1,419 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_edit.h"
+
+#include "qoa.h"
+#include "qoa_format.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace qoa {
+namespace {
+
+// The LmsState each channel starts `frame` from.
+std::vector<LmsState> frame_lms_states(std::span<std::uint8_t const> file,
+                                       FrameIndex const &index,
+                                       std::size_t frame) {
+  std::vector<LmsState> lms(index.nbr_channels);
+  auto const *data = &file[index.offset(frame) + kFrameHeaderSize];
+  for (auto &state : lms) {
+    state = parse_lms_state(data);
+    data += kLmsStateSize;
+  }
+
+  return lms;
+}
+
+// Leaves `decoder` at `sample` of `frame`, which has to be on a slice
+// boundary, and returns the LmsState each channel has there.
+std::vector<LmsState> seek_to_slice(Decoder &decoder,
+                                    std::span<std::uint8_t const> file,
+                                    FrameIndex const &index, std::size_t frame,
+                                    std::size_t sample) {
+  auto lms = frame_lms_states(file, index, frame);
+  decoder.seek(index.frames[frame].offset, index.frames[frame].first_sample);
+  if (sample > 0) {
+    std::vector<std::int16_t> skipped(sample * index.nbr_channels);
+    decoder.decode(skipped);
+    std::ranges::copy(decoder.lms_state(), lms.begin());
+  }
+
+  return lms;
+}
+
+// Whether every frame from `frame` on that ends before `count` samples later
+// is full, so the range can be copied frame by frame.
+bool frames_full(FrameIndex const &index, std::size_t frame,
+                 std::uint64_t count) {
+  auto const &frames = index.frames;
+  for (std::uint64_t end = frames[frame].sample_count; end < count;
+       end += frames[++frame].sample_count) {
+    if (frames[frame].sample_count != kFrameLen) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Writes `count` samples per channel from the start of `frame` on by
+// copying whole frames, and the slices of the last one that the range
+// reaches into behind a new header with the same LmsState. Nothing is
+// decoded. frames_full() has to hold.
+void append_copied(std::vector<std::uint8_t> &out,
+                   std::span<std::uint8_t const> file, FrameIndex const &index,
+                   std::size_t frame, std::uint64_t count) {
+  auto const channels = index.nbr_channels;
+  auto const &frames = index.frames;
+  auto last = frame;
+  for (; last < frames.size() && frames[last].sample_count <= count; ++last) {
+    count -= frames[last].sample_count;
+  }
+
+  auto const whole = file.subspan(index.offset(frame),
+                                  index.offset(last) - index.offset(frame));
+  out.insert(out.end(), whole.begin(), whole.end());
+  if (count == 0) {
+    return;
+  }
+
+  auto const n = static_cast<std::size_t>(count);
+  append_frame_header(out, index.sample_rate, n,
+                      frame_lms_states(file, index, last));
+  auto const body = file.subspan(
+      index.offset(last) + kFrameHeaderSize + kLmsStateSize * channels,
+      kSliceSize * ((n + kSliceLen - 1) / kSliceLen) * channels);
+  out.insert(out.end(), body.begin(), body.end());
+}
+
+// Whether the slices from `first` of `frame` until `count` samples later all
+// hold kSliceLen samples, apart from the very last one, so they can be
+// regrouped into new frames.
+bool slices_line_up(FrameIndex const &index, std::size_t frame,
+                    std::size_t first, std::uint64_t count) {
+  if (first % kSliceLen != 0) {
+    return false;
+  }
+
+  auto const &frames = index.frames;
+  for (std::uint64_t end = frames[frame].sample_count - first; end < count;
+       end += frames[++frame].sample_count) {
+    if (frames[frame].sample_count % kSliceLen != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Writes `count` samples per channel from `first` of `frame` on as frames of
+// kFrameLen samples, all but the last, made of the original slices. Each new
+// frame starts from the LmsState the decoder has at its first sample, so the
+// slices decode exactly as they did before. slices_line_up() has to hold.
+void append_repacked(std::vector<std::uint8_t> &out,
+                     std::span<std::uint8_t const> file,
+                     FrameIndex const &index, std::size_t frame,
+                     std::size_t first, std::uint64_t count) {
+  auto const channels = index.nbr_channels;
+  auto const &frames = index.frames;
+  auto decoder = *Decoder::parse(file);
+  auto lms = seek_to_slice(decoder, file, index, frame, first);
+  std::vector<std::int16_t> skipped(kFrameLen * channels);
+  auto pos = first;
+  for (std::uint64_t done = 0; done < count;) {
+    auto const n = static_cast<std::size_t>(
+        std::min<std::uint64_t>(kFrameLen, count - done));
+    append_frame_header(out, index.sample_rate, n, lms);
+    for (auto slices = (n + kSliceLen - 1) / kSliceLen; slices > 0;) {
+      if (pos >= frames[frame].sample_count) {
+        ++frame;
+        pos = 0;
+      }
+
+      auto const k = std::min(
+          slices, (frames[frame].sample_count - pos + kSliceLen - 1) /
+                      kSliceLen);
+      auto const body = file.subspan(
+          index.offset(frame) + kFrameHeaderSize + kLmsStateSize * channels +
+              kSliceSize * (pos / kSliceLen) * channels,
+          kSliceSize * k * channels);
+      out.insert(out.end(), body.begin(), body.end());
+      slices -= k;
+      pos += k * kSliceLen;
+    }
+
+    done += n;
+    if (done < count) {
+      decoder.decode(std::span{skipped}.first(n * channels));
+      if (pos >= frames[frame].sample_count) {
+        lms = frame_lms_states(file, index, frame + 1);
+      } else {
+        std::ranges::copy(decoder.lms_state(), lms.begin());
+      }
+    }
+  }
+}
+
+// Writes `count` samples per channel from `first` of `frame` on, encoded
+// again in frames of kFrameLen samples, all but the last. Encoding continues
+// from the decoder's LmsState at `first`.
+void append_encoded(std::vector<std::uint8_t> &out,
+                    std::span<std::uint8_t const> file, FrameIndex const &index,
+                    std::size_t frame, std::size_t first,
+                    std::uint64_t count) {
+  auto const channels = index.nbr_channels;
+  auto const slice_start = first - first % kSliceLen;
+  auto decoder = *Decoder::parse(file);
+  auto lms = seek_to_slice(decoder, file, index, frame, slice_start);
+  auto const skip = first - slice_start;
+  std::vector<std::int16_t> samples((skip + count) * channels);
+  decoder.decode(samples);
+  for (std::size_t i = 0; i < skip; ++i) {
+    for (std::size_t ch = 0; ch < channels; ++ch) {
+      advance_lms(lms[ch], samples[i * channels + ch]);
+    }
+  }
+
+  for (std::uint64_t done = 0; done < count; done += kFrameLen) {
+    auto const n = std::min<std::uint64_t>(kFrameLen, count - done);
+    auto const encoded = encode_frame(
+        std::span{samples}.subspan((skip + done) * channels, n * channels),
+        index.sample_rate, lms);
+    out.insert(out.end(), encoded.begin(), encoded.end());
+  }
+}
+
+// Encodes samples into frames of kFrameLen samples, all but the last, as
+// they're added, continuing from the LmsState it's given.
+class FrameEncoder {
+public:
+  FrameEncoder(std::vector<std::uint8_t> &out, std::uint32_t sample_rate,
+               std::vector<LmsState> lms)
+      : out_{out}, sample_rate_{sample_rate}, lms_{std::move(lms)} {
+    pending_.reserve(2 * kFrameLen * lms_.size());
+  }
+
+  void add(std::span<std::int16_t const> samples) {
+    pending_.insert(pending_.end(), samples.begin(), samples.end());
+    auto const frame = kFrameLen * lms_.size();
+    std::size_t done = 0;
+    for (; pending_.size() - done >= frame; done += frame) {
+      encode(std::span{pending_}.subspan(done, frame));
+    }
+    pending_.erase(pending_.begin(),
+                   pending_.begin() + static_cast<std::ptrdiff_t>(done));
+  }
+
+  void finish() {
+    if (!pending_.empty()) {
+      encode(pending_);
+      pending_.clear();
+    }
+  }
+
+private:
+  void encode(std::span<std::int16_t const> samples) {
+    auto const encoded = encode_frame(samples, sample_rate_, lms_);
+    out_.insert(out_.end(), encoded.begin(), encoded.end());
+  }
+
+  std::vector<std::uint8_t> &out_;
+  std::uint32_t sample_rate_{};
+  std::vector<LmsState> lms_;
+  std::vector<std::int16_t> pending_;
+};
+
+// Decodes `file` from the start of `frame` to the end into `encoder`.
+bool encode_from(FrameEncoder &encoder, std::span<std::uint8_t const> file,
+                 FrameIndex const &index, std::size_t frame) {
+  auto decoder = *Decoder::parse(file);
+  decoder.seek(index.frames[frame].offset, index.frames[frame].first_sample);
+  std::vector<std::int16_t> samples(kFrameLen * index.nbr_channels);
+  while (auto const n = decoder.decode_frame(samples)) {
+    encoder.add(std::span{samples}.first(n * index.nbr_channels));
+  }
+
+  return !decoder.error();
+}
+
+// Copies frames [first, last) of `file` into a file of their own.
+std::optional<std::vector<std::uint8_t>>
+copy_frames(std::span<std::uint8_t const> file, FrameIndex const &index,
+            std::size_t first, std::size_t last) {
+  if (first >= last) {
+    return std::nullopt;
+  }
+
+  std::uint64_t samples = 0;
+  for (std::size_t i = first; i < last; ++i) {
+    samples += index.frames[i].sample_count;
+  }
+
+  if (samples > std::numeric_limits<std::uint32_t>::max()) {
+    return std::nullopt;
+  }
+
+  auto const body = file.subspan(index.offset(first),
+                                 index.offset(last) - index.offset(first));
+  std::vector<std::uint8_t> out;
+  out.reserve(kFileHeaderSize + body.size());
+  append_file_header(out, static_cast<std::uint32_t>(samples));
+  out.insert(out.end(), body.begin(), body.end());
+  return out;
+}
+
+} // namespace
+
+std::optional<std::vector<std::uint8_t>>
+concat(std::span<std::span<std::uint8_t const> const> files) {
+  if (files.empty()) {
+    return std::nullopt;
+  }
+
+  std::uint64_t samples = 0;
+  std::size_t size = kFileHeaderSize;
+  std::vector<FrameIndex> indices;
+  indices.reserve(files.size());
+  for (auto file : files) {
+    auto index = index_frames(file);
+    if (!index || (!indices.empty() &&
+                   (index->sample_rate != indices[0].sample_rate ||
+                    index->nbr_channels != indices[0].nbr_channels))) {
+      return std::nullopt;
+    }
+
+    samples += index->sample_count();
+    size += index->end - index->offset(0);
+    indices.push_back(*std::move(index));
+  }
+
+  if (samples > std::numeric_limits<std::uint32_t>::max()) {
+    return std::nullopt;
+  }
+
+  std::vector<std::uint8_t> out;
+  out.reserve(size);
+  append_file_header(out, static_cast<std::uint32_t>(samples));
+  // Frames are copied as they are for as long as they're full, or the last
+  // one. The first short frame before that moves every sample after it, so
+  // from there on everything is encoded again.
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    auto const &index = indices[i];
+    auto const &frames = index.frames;
+    auto const last_file = i + 1 == files.size();
+    std::size_t full = 0;
+    while (full < frames.size() &&
+           (frames[full].sample_count == kFrameLen ||
+            (last_file && full + 1 == frames.size()))) {
+      ++full;
+    }
+
+    auto const body =
+        files[i].subspan(index.offset(0), index.offset(full) - index.offset(0));
+    out.insert(out.end(), body.begin(), body.end());
+    if (full == frames.size()) {
+      continue;
+    }
+
+    FrameEncoder encoder{out, index.sample_rate,
+                         frame_lms_states(files[i], index, full)};
+    if (!encode_from(encoder, files[i], index, full)) {
+      return std::nullopt;
+    }
+    for (auto j = i + 1; j < files.size(); ++j) {
+      if (!encode_from(encoder, files[j], indices[j], 0)) {
+        return std::nullopt;
+      }
+    }
+    encoder.finish();
+    break;
+  }
+
+  return out;
+}
+
+std::optional<std::vector<std::uint8_t>>
+trim_frames(std::span<std::uint8_t const> file, std::size_t first_frame,
+            std::size_t frame_count) {
+  auto index = index_frames(file);
+  if (!index) {
+    return std::nullopt;
+  }
+
+  auto const total = index->frames.size();
+  auto const first = std::min(first_frame, total);
+  auto const last = first + std::min(frame_count, total - first);
+  return copy_frames(file, *index, first, last);
+}
+
+std::optional<std::vector<std::uint8_t>>
+trim_samples(std::span<std::uint8_t const> file, std::uint64_t first_sample,
+             std::uint64_t sample_count) {
+  auto index = index_frames(file);
+  if (!index) {
+    return std::nullopt;
+  }
+
+  auto const total = index->sample_count();
+  if (first_sample >= total || sample_count == 0) {
+    return std::nullopt;
+  }
+
+  auto const last_sample =
+      first_sample + std::min(sample_count, total - first_sample);
+  if (last_sample - first_sample > std::numeric_limits<std::uint32_t>::max()) {
+    return std::nullopt;
+  }
+
+  auto const count = last_sample - first_sample;
+  std::size_t frame = 0;
+  std::uint64_t frame_start = 0;
+  while (frame_start + index->frames[frame].sample_count <= first_sample) {
+    frame_start += index->frames[frame++].sample_count;
+  }
+
+  auto const first = static_cast<std::size_t>(first_sample - frame_start);
+  std::vector<std::uint8_t> out;
+  append_file_header(out, static_cast<std::uint32_t>(count));
+  if (first == 0 && frames_full(*index, frame, count)) {
+    append_copied(out, file, *index, frame, count);
+  } else if (slices_line_up(*index, frame, first, count)) {
+    append_repacked(out, file, *index, frame, first, count);
+  } else {
+    append_encoded(out, file, *index, frame, first, count);
+  }
+
+  return out;
+}
+
+std::optional<std::vector<std::vector<std::uint8_t>>>
+split_frames(std::span<std::uint8_t const> file, std::size_t frames_per_part) {
+  auto index = index_frames(file);
+  if (!index || frames_per_part == 0) {
+    return std::nullopt;
+  }
+
+  auto const total = index->frames.size();
+  std::vector<std::vector<std::uint8_t>> parts;
+  for (std::size_t first = 0; first < total; first += frames_per_part) {
+    auto const last = first + std::min(frames_per_part, total - first);
+    auto part = copy_frames(file, *index, first, last);
+    if (!part) {
+      return std::nullopt;
+    }
+    parts.push_back(*std::move(part));
+  }
+
+  return parts;
+}
+
+} // namespace qoa
@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_EDIT_H_
+#define AUDIO_QOA_EDIT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// Editing at frame granularity. Every frame carries the LmsState it starts
+// from, so frames can be copied between files as-is, with only the sample
+// count in the file header rewritten, and decode exactly as they did before.
+//
+// All of these return nullopt if an input isn't a valid QOA file.
+
+// Joins files with the same sample rate and channel count back to back, so
+// the output passes Validation::Strict. Frames are copied as-is, and decode
+// exactly as before, up to the first short frame that isn't the last one of
+// the output, as when a file other than the last doesn't end on a full
+// frame. Every sample after that moves, so from that frame on all inputs are
+// decoded and encoded again, continuing from its LmsState, which costs
+// O(samples after it) and a little quality.
+std::optional<std::vector<std::uint8_t>> concat(std::span<std::span<std::uint8_t const> const> files);
+
+// Keeps frame_count frames starting at first_frame, or as many of them as
+// there are. Returns nullopt if that's none.
+std::optional<std::vector<std::uint8_t>> trim_frames(
+        std::span<std::uint8_t const> file, std::size_t first_frame, std::size_t frame_count);
+
+// Keeps sample_count samples per channel starting at first_sample, or as
+// many of them as there are, in frames of kFrameLen samples but the last, so
+// the output passes Validation::Strict. Returns nullopt if the range is
+// empty. How much work that is depends on where the range starts:
+// - On a frame boundary, with every frame up to the end of the range full,
+//   as in any file whose frames but the last are full, whole frames are
+//   copied and the last one is cut short. Nothing is decoded.
+// - On a 20-sample slice boundary, with every slice up to the end of the
+//   range holding 20 samples, the slices are regrouped as they are, each
+//   new frame starting from the decoder's LmsState at its first sample.
+//   The output decodes exactly as before, but the whole range is decoded.
+// - Otherwise every slice would move, so the whole range is decoded and
+//   encoded again, continuing from the decoder's LmsState at first_sample.
+//   That is O(range) encoding work, and lossy: the output is a second
+//   generation, around 33 dB SNR against the decoded input on music.
+std::optional<std::vector<std::uint8_t>> trim_samples(
+        std::span<std::uint8_t const> file, std::uint64_t first_sample, std::uint64_t sample_count);
+
+// Cuts the file into parts of frames_per_part frames, the last one holding
+// whatever is left.
+std::optional<std::vector<std::vector<std::uint8_t>>> split_frames(
+        std::span<std::uint8_t const> file, std::size_t frames_per_part);
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,157 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa.h"
+#include "qoa_edit.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, std::string const &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+std::optional<std::vector<std::uint8_t>> read_file(char const *path) {
+    std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+    if (!fs) {
+        return std::nullopt;
+    }
+
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>{fs}, {});
+}
+
+std::optional<qoa::Qoa> parse_strict(std::span<std::uint8_t const> file) {
+    return qoa::Qoa::parse(file, {.validation = qoa::Validation::Strict});
+}
+
+// Trims `file` and checks that the output is spec-conformant, holds the
+// right number of samples, and, if `exact`, decodes to exactly the samples
+// it was cut from.
+void test_trim_samples(std::span<std::uint8_t const> file,
+        qoa::Qoa const &decoded,
+        std::uint64_t first,
+        std::uint64_t count,
+        bool exact) {
+    auto const what = "trim_samples(" + std::to_string(first) + ", " + std::to_string(count) + ")";
+    auto trimmed = qoa::trim_samples(file, first, count);
+    expect(trimmed.has_value(), what);
+    if (!trimmed) {
+        return;
+    }
+
+    auto qoa = parse_strict(*trimmed);
+    expect(qoa.has_value(), what + " decodes with Validation::Strict");
+    if (!qoa) {
+        return;
+    }
+
+    auto const channels = decoded.nbr_channels;
+    expect(qoa->audio_frames.size() == count * channels, what + " keeps the samples asked for");
+    if (exact && qoa->audio_frames.size() == count * channels) {
+        auto const expected = std::span{decoded.audio_frames}.subspan(first * channels, count * channels);
+        expect(std::ranges::equal(qoa->audio_frames, expected), what + " decodes as the original did");
+    }
+}
+
+// Joins `parts` and checks that the output is spec-conformant, holds all of
+// their samples, and, if `exact`, decodes to exactly their samples.
+std::optional<std::vector<std::uint8_t>> test_concat(
+        std::span<std::span<std::uint8_t const> const> parts, std::string const &what, bool exact) {
+    auto joined = qoa::concat(parts);
+    auto const qoa = joined ? parse_strict(*joined) : std::nullopt;
+    expect(qoa.has_value(), what + " decodes with Validation::Strict");
+    if (!qoa) {
+        return std::nullopt;
+    }
+
+    std::vector<std::int16_t> expected;
+    for (auto part : parts) {
+        auto const decoded = qoa::Qoa::parse(part);
+        expected.insert(expected.end(), decoded->audio_frames.begin(), decoded->audio_frames.end());
+    }
+
+    expect(qoa->audio_frames.size() == expected.size(), what + " keeps every sample");
+    if (exact) {
+        expect(qoa->audio_frames == expected, what + " decodes as the inputs did");
+    }
+
+    return joined;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: qoa_edit_test <file.qoa>\n");
+        return EXIT_FAILURE;
+    }
+
+    auto file = read_file(argv[1]);
+    auto decoded = file ? parse_strict(*file) : std::nullopt;
+    if (!decoded) {
+        std::fprintf(stderr, "Unable to decode %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    auto const total = decoded->audio_frames.size() / decoded->nbr_channels;
+
+    // Cuts on frame boundaries copy the original frames.
+    test_trim_samples(*file, *decoded, 0, total, true);
+    test_trim_samples(*file, *decoded, qoa::kFrameLen, 2 * qoa::kFrameLen, true);
+    test_trim_samples(*file, *decoded, 2 * qoa::kFrameLen, 3 * qoa::kFrameLen + 77, true);
+    test_trim_samples(*file, *decoded, 0, 13, true);
+
+    // Cuts on slice boundaries regroup the original slices.
+    test_trim_samples(*file, *decoded, 40, 100'000, true);
+    test_trim_samples(*file, *decoded, 3 * qoa::kFrameLen + 7 * qoa::kSliceLen, 2 * qoa::kFrameLen + 13, true);
+    test_trim_samples(*file, *decoded, total - 100, 100, true);
+
+    // Cuts inside a slice are encoded again.
+    test_trim_samples(*file, *decoded, 7, 30'000, false);
+    test_trim_samples(*file, *decoded, qoa::kFrameLen + 5, 3 * qoa::kFrameLen, false);
+
+    // Full frames are copied as they are, and a short one ahead of the last
+    // moves every sample after it, so the rest is encoded again.
+    auto const head = qoa::trim_frames(*file, 0, 1);
+    auto const tail = qoa::trim_frames(*file, 1, 4);
+    auto const short_head = head ? qoa::trim_samples(*head, 0, 1003) : std::nullopt;
+    if (head && short_head && tail) {
+        std::array<std::span<std::uint8_t const>, 2> const aligned{*head, *tail};
+        test_concat(aligned, "concat(full frame, tail)", true);
+
+        std::array<std::span<std::uint8_t const>, 3> const parts{*short_head, *tail, *short_head};
+        auto const joined = test_concat(parts, "concat(short frame, tail, short frame)", false);
+        if (joined) {
+            test_trim_samples(*joined, *parse_strict(*joined), 500, 8'000, true);
+        }
+    } else {
+        expect(false, "trim_frames");
+    }
+
+    auto const frames = qoa::trim_frames(*file, 2, 5);
+    expect(frames && parse_strict(*frames), "trim_frames(2, 5) decodes with Validation::Strict");
+
+    if (failures != 0) {
+        return EXIT_FAILURE;
+    }
+
+    std::printf("All tests passed\n");
+}
@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_ENDIAN_H_
+#define AUDIO_QOA_ENDIAN_H_
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace qoa {
+
+static_assert(std::endian::native == std::endian::big || std::endian::native == std::endian::little,
+        "Mixed endian is unsupported right now");
+
+// Loads and stores of integers at any alignment, in QOA's big-endian byte
+// order or the little-endian one of the containers built around it. Outside
+// of constant evaluation they're a single unaligned load or store, and a
+// byte swap if the byte order isn't the native one.
+//
+// The constant-evaluated path is there so the parsing built on these can be
+// checked with static_assert.
+
+template <std::integral T>
+constexpr T load_be(std::uint8_t const *data) {
+    using U = std::make_unsigned_t<T>;
+    if (std::is_constant_evaluated()) {
+        U v{};
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            v = static_cast<U>(v << 8 | data[i]);
+        }
+        return static_cast<T>(v);
+    }
+
+    U v{};
+    std::memcpy(&v, data, sizeof(v));
+    if constexpr (std::endian::native == std::endian::little) {
+        v = std::byteswap(v);
+    }
+    return static_cast<T>(v);
+}
+
+// The u24 QOA uses for sample rates.
+constexpr std::uint32_t load_be24(std::uint8_t const *data) {
+    return std::uint32_t{data[0]} << 16 | load_be<std::uint16_t>(data + 1);
+}
+
+template <std::integral T>
+constexpr T load_le(std::uint8_t const *data) {
+    using U = std::make_unsigned_t<T>;
+    if (std::is_constant_evaluated()) {
+        U v{};
+        for (std::size_t i = sizeof(T); i-- > 0;) {
+            v = static_cast<U>(v << 8 | data[i]);
+        }
+        return static_cast<T>(v);
+    }
+
+    U v{};
+    std::memcpy(&v, data, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big) {
+        v = std::byteswap(v);
+    }
+    return static_cast<T>(v);
+}
+
+template <std::integral T>
+void store_be(std::uint8_t *data, T v) {
+    if constexpr (std::endian::native == std::endian::little) {
+        v = std::byteswap(v);
+    }
+    std::memcpy(data, &v, sizeof(v));
+}
+
+inline void store_be24(std::uint8_t *data, std::uint32_t v) {
+    data[0] = static_cast<std::uint8_t>(v >> 16);
+    store_be(data + 1, static_cast<std::uint16_t>(v));
+}
+
+template <std::integral T>
+void store_le(std::uint8_t *data, T v) {
+    if constexpr (std::endian::native == std::endian::big) {
+        v = std::byteswap(v);
+    }
+    std::memcpy(data, &v, sizeof(v));
+}
+
+} // namespace qoa
+
+#endif
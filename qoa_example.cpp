@@ -3,18 +3,734 @@
 // SPDX-License-Identifier: BSD-2-Clause
 
 #include "qoa.h"
+#include "qoa_analysis.h"
+#include "qoa_async.h"
+#include "qoa_bank.h"
+#include "qoa_edit.h"
+#include "qoa_frame_pool.h"
+#include "qoa_loader.h"
+#include "qoa_thread_pool.h"
+#include "qoa_transcoder.h"
+#include "qoa_waveform.h"
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::string_view kUsage = R"(Usage: qoa_example <file.qoa>
+       qoa_example bank build <out.bank> <file.qoa>...
+       qoa_example bank list <in.bank>
+       qoa_example bank extract <in.bank> <name> <out.qoa>
+       qoa_example bench <file.qoa> [iterations]
+       qoa_example bench - < <file.qoa>
+       qoa_example bench-load <file.qoa>...
+       qoa_example concat <out.qoa> <file.qoa>...
+       qoa_example split <file.qoa> <frames-per-part> <out-prefix>
+       qoa_example trim <file.qoa> <first-frame> <frame-count> <out.qoa>
+       qoa_example trim-samples <file.qoa> <first-sample> <sample-count> <out.qoa>
+       qoa_example envelope <file.qoa> [ms-per-line]
+       qoa_example stats <file.qoa>
+       qoa_example stream <file.qoa>|-
+       qoa_example convert <in-dir> <out-dir> [--to wav|raw|f32] [-j N]
+       qoa_example waveform build <file.qoa> <out.qoaw> [threads]
+       qoa_example waveform show <in.qoaw> <level>
+)";
+
+std::optional<std::vector<std::uint8_t>> read_file(std::filesystem::path const &path) {
+    std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+    if (!fs) {
+        return std::nullopt;
+    }
+
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>{fs}, {});
+}
+
+bool write_file(std::filesystem::path const &path, std::span<std::uint8_t const> data) {
+    std::ofstream fs{path, std::ofstream::out | std::ofstream::binary};
+    fs.write(reinterpret_cast<char const *>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(fs);
+}
+
+int bank_build(std::filesystem::path const &out, std::span<char *> files) {
+    std::vector<std::vector<std::uint8_t>> contents;
+    std::vector<qoa::Bank::Input> inputs;
+    contents.reserve(files.size());
+    for (std::filesystem::path file : files) {
+        auto data = read_file(file);
+        if (!data) {
+            std::cerr << "Unable to read " << file << '\n';
+            return 1;
+        }
+
+        contents.push_back(*std::move(data));
+        inputs.push_back({.name = file.stem().string(), .data = contents.back()});
+    }
+
+    auto bank = qoa::Bank::build(inputs);
+    if (!bank) {
+        std::cerr << "Unable to build bank, invalid input or duplicate name\n";
+        return 1;
+    }
+
+    if (!write_file(out, *bank)) {
+        std::cerr << "Unable to write " << out << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int bank_list(char const *path) {
+    auto bank = qoa::Bank::open(path);
+    if (!bank) {
+        std::cerr << "Unable to open bank " << path << '\n';
+        return 1;
+    }
+
+    for (std::size_t i = 0; i < bank->size(); ++i) {
+        auto e = *bank->entry(i);
+        std::cout << bank->name(e) << ": " << e.size << " bytes, " << e.sample_count << " samples, "
+                  << e.sample_rate << " Hz, " << e.nbr_channels << " channel(s), " << e.frame_count << " frames\n";
+    }
+
+    return 0;
+}
+
+int bank_extract(char const *path, std::string_view name, std::filesystem::path const &out) {
+    auto bank = qoa::Bank::open(path);
+    if (!bank) {
+        std::cerr << "Unable to open bank " << path << '\n';
+        return 1;
+    }
+
+    auto e = bank->find(name);
+    if (!e) {
+        std::cerr << "No entry named " << name << '\n';
+        return 1;
+    }
+
+    if (!write_file(out, bank->data(*e))) {
+        std::cerr << "Unable to write " << out << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int bank(std::span<char *> args) {
+    std::string_view cmd = args.empty() ? "" : args[0];
+    if (cmd == "build" && args.size() >= 3) {
+        return bank_build(args[1], args.subspan(2));
+    }
+
+    if (cmd == "list" && args.size() == 2) {
+        return bank_list(args[1]);
+    }
+
+    if (cmd == "extract" && args.size() == 4) {
+        return bank_extract(args[1], args[2], args[3]);
+    }
+
+    std::cerr << kUsage;
+    return 1;
+}
+
+int waveform_build(char const *path, std::filesystem::path const &out, std::size_t threads) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    auto waveform = qoa::Waveform::build(*data, threads);
+    auto const end = std::chrono::steady_clock::now();
+    if (!waveform) {
+        std::cerr << "Unable to parse " << path << '\n';
+        return 1;
+    }
+
+    auto const sidecar = waveform->serialize();
+    if (!write_file(out, sidecar)) {
+        std::cerr << "Unable to write " << out << '\n';
+        return 1;
+    }
+
+    std::cout << waveform->sample_count() << " samples summarized in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms, " << sidecar.size()
+              << " bytes written\n";
+    return 0;
+}
+
+// Prints every bucket of a level as its first sample's time followed by
+// min/max/RMS for every channel.
+int waveform_show(char const *path, std::size_t level) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto waveform = qoa::Waveform::parse(*data);
+    if (!waveform || level >= qoa::Waveform::kBucketSizes.size()) {
+        std::cerr << "Unable to parse " << path << " or no level " << level << '\n';
+        return 1;
+    }
+
+    auto const channels = waveform->nbr_channels();
+    auto const buckets = waveform->level(level);
+    for (std::size_t i = 0; i < buckets.size(); i += channels) {
+        std::cout << static_cast<double>(i / channels * qoa::Waveform::kBucketSizes[level]) / waveform->sample_rate();
+        for (std::size_t ch = 0; ch < channels; ++ch) {
+            auto const &b = buckets[i + ch];
+            std::cout << '\t' << b.min << '/' << b.max << '/' << b.rms;
+        }
+        std::cout << '\n';
+    }
+
+    return 0;
+}
+
+int waveform(std::span<char *> args) {
+    std::string_view cmd = args.empty() ? "" : args[0];
+    if (cmd == "build" && (args.size() == 3 || args.size() == 4)) {
+        return waveform_build(
+                args[1], args[2], args.size() == 4 ? static_cast<std::size_t>(std::strtoull(args[3], nullptr, 10)) : 0);
+    }
+
+    if (cmd == "show" && args.size() == 3) {
+        return waveform_show(args[1], static_cast<std::size_t>(std::strtoull(args[2], nullptr, 10)));
+    }
+
+    std::cerr << kUsage;
+    return 1;
+}
+
+int concat(std::filesystem::path const &out, std::span<char *> files) {
+    std::vector<std::vector<std::uint8_t>> contents;
+    for (auto const *file : files) {
+        auto data = read_file(file);
+        if (!data) {
+            std::cerr << "Unable to read " << file << '\n';
+            return 1;
+        }
+        contents.push_back(*std::move(data));
+    }
+
+    std::vector<std::span<std::uint8_t const>> inputs(contents.begin(), contents.end());
+    auto joined = qoa::concat(inputs);
+    if (!joined) {
+        std::cerr << "Unable to concatenate, invalid input or mismatched formats\n";
+        return 1;
+    }
+
+    if (!write_file(out, *joined)) {
+        std::cerr << "Unable to write " << out << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int split(char const *path, std::size_t frames_per_part, std::string_view prefix) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto parts = qoa::split_frames(*data, frames_per_part);
+    if (!parts) {
+        std::cerr << "Unable to split " << path << '\n';
+        return 1;
+    }
+
+    for (std::size_t i = 0; i < parts->size(); ++i) {
+        auto const out = std::string{prefix} + '_' + std::to_string(i) + ".qoa";
+        if (!write_file(out, (*parts)[i])) {
+            std::cerr << "Unable to write " << out << '\n';
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int trim(char const *path, std::size_t first, std::size_t count, std::filesystem::path const &out, bool samples) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto trimmed = samples ? qoa::trim_samples(*data, first, count) : qoa::trim_frames(*data, first, count);
+    if (!trimmed) {
+        std::cerr << "Unable to trim " << path << ", invalid input or nothing in range\n";
+        return 1;
+    }
+
+    if (!write_file(out, *trimmed)) {
+        std::cerr << "Unable to write " << out << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+// Prints the loudest slice of every channel for every ms_per_line of audio.
+int envelope(char const *path, int ms_per_line) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto env = qoa::scale_factor_envelope(*data);
+    if (!env) {
+        std::cerr << "Unable to parse " << path << '\n';
+        return 1;
+    }
+
+    auto const channels = env->nbr_channels;
+    auto const slices_per_line =
+            std::max<std::size_t>(1, std::size_t{env->sample_rate} * ms_per_line / 1000 / qoa::kSliceLen);
+    auto const &sf = env->scale_factors;
+    for (std::size_t first = 0; first < sf.size(); first += slices_per_line * channels) {
+        auto const last = std::min(sf.size(), first + slices_per_line * channels);
+        std::cout << static_cast<double>(first / channels * qoa::kSliceLen) / env->sample_rate;
+        for (std::size_t ch = 0; ch < channels; ++ch) {
+            std::uint16_t peak = 0;
+            for (auto i = first + ch; i < last; i += channels) {
+                peak = std::max(peak, sf[i]);
+            }
+            std::cout << '\t' << peak;
+        }
+        std::cout << '\n';
+    }
+
+    return 0;
+}
+
+// Decodes the file a frame at a time, never holding more than one of them.
+int stream(std::string_view path) {
+    std::ifstream fs;
+    if (path != "-") {
+        fs.open(std::string{path}, std::ifstream::in | std::ifstream::binary);
+    }
+
+    auto decoder = qoa::StreamDecoder::parse(path == "-" ? std::cin : fs);
+    if (!decoder) {
+        std::cerr << "Unable to parse " << path << '\n';
+        return 1;
+    }
+
+    auto const peak = [](std::span<std::int16_t const> frame) {
+        int p = 0;
+        for (int s : frame) {
+            p = std::max(p, std::abs(s));
+        }
+        return p;
+    };
+
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t frames = 0;
+    int max_peak = 0;
+    for (auto p : decoder->frames() | std::views::transform(peak)) {
+        ++frames;
+        max_peak = std::max(max_peak, p);
+    }
+    auto const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (decoder->error()) {
+        std::cerr << "Malformed frame after " << frames << " frames\n";
+        return 1;
+    }
+
+    std::cout << frames << " frames streamed in " << ms << " ms, peak " << max_peak << '\n';
+    return 0;
+}
+
+// Prints what normalizing the file would need to know, gathered while it's
+// decoded.
+int stats(char const *path) {
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    qoa::DecodeStats stats;
+    auto qoa = qoa::Qoa::parse(*data, {.stats = &stats});
+    if (!qoa) {
+        std::cerr << "Unable to parse " << path << '\n';
+        return 1;
+    }
+
+    auto const dbfs = [](double v) { return 20 * std::log10(std::max(v, 1.) / 32768); };
+    for (std::size_t ch = 0; ch < qoa->nbr_channels; ++ch) {
+        auto const &c = stats.channels[ch];
+        std::cout << "channel " << ch << ": peak " << dbfs(c.peak) << " dBFS, RMS " << dbfs(stats.rms(ch))
+                  << " dBFS, DC offset " << stats.dc_offset(ch) << ", " << c.clipped << " clipped samples\n";
+    }
+
+    return 0;
+}
+
+// Unbuffered stream buffer over stdin that counts how many times it has to
+// read from it, so every read the decoder makes shows up as a syscall.
+class CountingStdinBuf : public std::streambuf {
+public:
+    std::size_t reads() const { return reads_; }
+
+protected:
+    int_type underflow() override {
+        if (read_stdin(&ch_, 1) != 1) {
+            return traits_type::eof();
+        }
+
+        setg(&ch_, &ch_, &ch_ + 1);
+        return traits_type::to_int_type(ch_);
+    }
+
+    std::streamsize xsgetn(char *s, std::streamsize n) override {
+        std::streamsize got = 0;
+        if (gptr() < egptr()) {
+            s[got++] = *gptr();
+            gbump(1);
+        }
+
+        while (got < n) {
+            auto const r = read_stdin(s + got, n - got);
+            if (r <= 0) {
+                break;
+            }
+            got += r;
+        }
+
+        return got;
+    }
+
+private:
+    std::streamsize read_stdin(char *dst, std::streamsize n) {
+        ++reads_;
+#ifdef _WIN32
+        return _read(0, dst, static_cast<unsigned>(n));
+#else
+        return ::read(0, dst, static_cast<std::size_t>(n));
+#endif
+    }
+
+    char ch_{};
+    std::size_t reads_{};
+};
+
+// Times Qoa::parse on stdin, which is usually a pipe and can't be seeked
+// or mapped, and reports how many reads it took.
+int bench_stdin() {
+    CountingStdinBuf buf;
+    std::istream is{&buf};
+    auto const start = std::chrono::steady_clock::now();
+    auto qoa = qoa::Qoa::parse(is);
+    auto const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!qoa) {
+        std::cerr << "Unable to parse stdin\n";
+        return 1;
+    }
+
+    auto const frames = (qoa->audio_frames.size() / qoa->nbr_channels + qoa::kFrameLen - 1) / qoa::kFrameLen;
+    std::cout << "Qoa::parse from stdin: " << ms << " ms, " << buf.reads() << " reads for " << frames << " frames ("
+              << static_cast<double>(buf.reads()) / static_cast<double>(frames) << " per frame)\n";
+    return 0;
+}
+
+// The best and median of running something a number of times, in ms.
+struct Timing {
+    double best{};
+    double median{};
+};
+
+std::ostream &operator<<(std::ostream &os, Timing const &timing) {
+    return os << "best " << timing.best << " ms, median " << timing.median << " ms";
+}
+
+// `iterations` has to be at least 1.
+template <typename Fn>
+Timing time_best_median(std::size_t iterations, Fn fn) {
+    assert(iterations >= 1);
+    std::vector<double> times(iterations);
+    for (auto &time : times) {
+        auto const start = std::chrono::steady_clock::now();
+        fn();
+        time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::ranges::sort(times);
+    return {.best = times.front(), .median = times[times.size() / 2]};
+}
+
+// Times decoding a file that's already in memory, frame by frame.
+int bench(char const *path, std::size_t iterations) {
+    if (path == std::string_view{"-"}) {
+        return bench_stdin();
+    }
+
+    auto data = read_file(path);
+    if (!data) {
+        std::cerr << "Unable to read " << path << '\n';
+        return 1;
+    }
+
+    auto decoder = qoa::Decoder::parse(*data);
+    if (!decoder) {
+        std::cerr << "Unable to parse " << path << '\n';
+        return 1;
+    }
+
+    std::vector<std::int16_t> frame(qoa::kFrameLen * decoder->nbr_channels());
+    std::size_t samples = 0;
+    auto time_decode = [&](qoa::DecodeOptions const &options) {
+        return time_best_median(iterations, [&] {
+            auto d = *qoa::Decoder::parse(*data, options);
+            samples = 0;
+            while (auto n = d.decode_frame(frame)) {
+                samples += n;
+            }
+        });
+    };
+
+    auto const decode = time_decode({});
+    auto const skip_silence = time_decode({.skip_silence = true});
+    auto const trusted = time_decode({.validation = qoa::Validation::Trusted});
+    auto const strict = time_decode({.validation = qoa::Validation::Strict});
+
+    // Every frame in a buffer of its own from the pool, as if it were handed
+    // off to a consumer, with the previous one going back as it's replaced.
+    qoa::FramePool frame_pool{2, decoder->nbr_channels()};
+    auto const frame_pool_decode = time_best_median(iterations, [&] {
+        auto d = *qoa::Decoder::parse(*data);
+        qoa::FrameBuffer handed_off;
+        for (auto buffer = frame_pool.acquire(); buffer && d.decode_frame(buffer->samples()) > 0;
+                buffer = frame_pool.acquire()) {
+            handed_off = *std::move(buffer);
+        }
+    });
+
+    auto const envelope = time_best_median(iterations, [&] { std::ignore = qoa::scale_factor_envelope(*data); });
+
+    // Decoding into an arena on a buffer that's reused between iterations,
+    // like it would be between level loads, never touches the global heap.
+    auto const parse = time_best_median(iterations, [&] { std::ignore = qoa::Qoa::parse(*data); });
+    std::vector<std::byte> arena_buffer((decoder->sample_count() + qoa::kFrameLen) * decoder->nbr_channels()
+            * sizeof(std::int16_t));
+    auto const pmr_parse = time_best_median(iterations, [&] {
+        std::pmr::monotonic_buffer_resource arena{arena_buffer.data(), arena_buffer.size()};
+        std::ignore = qoa::pmr::Qoa::parse(*data, {}, &arena);
+    });
+
+    // Includes copying the file, which async_decode takes ownership of.
+    qoa::ThreadPool pool;
+    auto const async = time_best_median(iterations, [&] { std::ignore = qoa::async_decode(*data, pool).get(); });
+
+    std::cout << path << ": " << samples << " samples x " << decoder->nbr_channels() << " channel(s), " << iterations
+              << " iterations\n"
+              << "decode_frame: " << decode << ", " << static_cast<double>(samples) / decode.best / 1000
+              << " Msamples/s per channel\n"
+              << "decode_frame with Validation::Trusted: " << trusted << '\n'
+              << "decode_frame with Validation::Strict: " << strict << '\n'
+              << "decode_frame with skip_silence: " << skip_silence << '\n'
+              << "decode_frame into FramePool buffers: " << frame_pool_decode << '\n'
+              << "scale_factor_envelope: " << envelope << '\n'
+              << "Qoa::parse: " << parse << '\n'
+              << "pmr::Qoa::parse into an arena: " << pmr_parse << '\n'
+              << "async_decode on " << pool.size() << " thread(s): " << async << '\n';
+    return 0;
+}
+
+// Times loading all the files, first one after the other with blocking reads,
+// then with load_files overlapping the reads with decoding.
+int bench_load(std::span<char *> files) {
+    std::vector<std::string> paths(files.begin(), files.end());
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t loaded = 0;
+    for (auto const &path : paths) {
+        std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+        std::ostream null{nullptr};
+        auto *cout = std::cout.rdbuf(null.rdbuf());
+        auto *cerr = std::cerr.rdbuf(null.rdbuf());
+        loaded += qoa::Qoa::parse(fs).has_value();
+        std::cout.rdbuf(cout);
+        std::cerr.rdbuf(cerr);
+    }
+    auto const sequential_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    auto results = qoa::load_files(paths);
+    auto const async_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    auto const async_loaded = std::ranges::count_if(results, [](auto const &r) { return r.has_value(); });
+    std::cout << paths.size() << " files\n"
+              << "sequential Qoa::parse: " << sequential_ms << " ms, " << loaded << " loaded\n"
+              << "load_files (" << (qoa::io_uring_available() ? "io_uring" : "thread pool") << "): " << async_ms
+              << " ms, " << async_loaded << " loaded\n";
+    return 0;
+}
+
+std::optional<qoa::OutputFormat> parse_format(std::string_view format) {
+    if (format == "wav") {
+        return qoa::OutputFormat::Wav;
+    }
+
+    if (format == "raw") {
+        return qoa::OutputFormat::Raw;
+    }
+
+    if (format == "f32") {
+        return qoa::OutputFormat::F32;
+    }
+
+    return std::nullopt;
+}
+
+// Converts every .qoa file under in_dir to a file at the same relative path
+// under out_dir.
+int convert(std::span<char *> args) {
+    if (args.size() < 2) {
+        std::cerr << kUsage;
+        return 1;
+    }
+
+    std::filesystem::path const in_dir{args[0]};
+    std::filesystem::path const out_dir{args[1]};
+    std::string_view extension = ".wav";
+    qoa::TranscodeOptions options;
+    for (std::size_t i = 2; i < args.size(); ++i) {
+        std::string_view arg = args[i];
+        if (arg == "--to" && i + 1 < args.size()) {
+            auto format = parse_format(args[++i]);
+            if (!format) {
+                std::cerr << kUsage;
+                return 1;
+            }
+            options.format = *format;
+            extension = *format == qoa::OutputFormat::Wav ? ".wav" : *format == qoa::OutputFormat::Raw ? ".raw" : ".f32";
+        } else if (arg == "-j" && i + 1 < args.size()) {
+            options.decode_threads = static_cast<std::size_t>(std::max(1, std::atoi(args[++i])));
+            options.convert_threads = options.decode_threads;
+        } else {
+            std::cerr << kUsage;
+            return 1;
+        }
+    }
+
+    std::vector<qoa::TranscodeJob> jobs;
+    std::error_code ec;
+    for (auto const &entry : std::filesystem::recursive_directory_iterator{in_dir, ec}) {
+        if (entry.is_regular_file() && entry.path().extension() == ".qoa") {
+            auto out = out_dir / std::filesystem::relative(entry.path(), in_dir);
+            jobs.push_back({.in = entry.path(), .out = out.replace_extension(extension)});
+        }
+    }
+
+    if (ec) {
+        std::cerr << "Unable to read " << in_dir << '\n';
+        return 1;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const stats = qoa::transcode(jobs, options);
+    auto const s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    constexpr double kMiB = 1024 * 1024;
+    std::cout << stats.files << " files converted, " << stats.failed << " failed in " << s << " s\n"
+              << static_cast<double>(stats.bytes_read) / kMiB / s << " MiB/s read, "
+              << static_cast<double>(stats.bytes_written) / kMiB / s << " MiB/s written, "
+              << static_cast<double>(stats.samples) / s / 1e6 << " Msamples/s per channel decoded\n";
+    return stats.failed == 0 ? 0 : 1;
+}
+
+} // namespace
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        // TODO(robinlinden)
-        std::cerr << "Usage ...\n";
+    std::span<char *> args{argv + 1, static_cast<std::size_t>(argc - 1)};
+    if (!args.empty() && args[0] == std::string_view{"bank"}) {
+        return bank(args.subspan(1));
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"bench"} && (args.size() == 2 || args.size() == 3)) {
+        return bench(args[1], args.size() == 3 ? static_cast<std::size_t>(std::max(1, std::atoi(args[2]))) : 20);
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"bench-load"} && args.size() >= 2) {
+        return bench_load(args.subspan(1));
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"concat"} && args.size() >= 3) {
+        return concat(args[1], args.subspan(2));
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"split"} && args.size() == 4) {
+        return split(args[1], static_cast<std::size_t>(std::strtoull(args[2], nullptr, 10)), args[3]);
+    }
+
+    if (!args.empty() && (args[0] == std::string_view{"trim"} || args[0] == std::string_view{"trim-samples"})
+            && args.size() == 5) {
+        return trim(args[1],
+                static_cast<std::size_t>(std::strtoull(args[2], nullptr, 10)),
+                static_cast<std::size_t>(std::strtoull(args[3], nullptr, 10)),
+                args[4],
+                args[0] == std::string_view{"trim-samples"});
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"envelope"} && (args.size() == 2 || args.size() == 3)) {
+        return envelope(args[1], args.size() == 3 ? std::max(1, std::atoi(args[2])) : 100);
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"stats"} && args.size() == 2) {
+        return stats(args[1]);
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"stream"} && args.size() == 2) {
+        return stream(args[1]);
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"convert"}) {
+        return convert(args.subspan(1));
+    }
+
+    if (!args.empty() && args[0] == std::string_view{"waveform"}) {
+        return waveform(args.subspan(1));
+    }
+
+    if (args.size() != 1) {
+        std::cerr << kUsage;
         return 1;
     }
 
-    std::ifstream fs{argv[1], std::ifstream::in | std::ifstream::binary};
+    std::ifstream fs{args[0], std::ifstream::in | std::ifstream::binary};
     if (!fs) {
         std::cerr << "Oh no ...\n";
         return 1;
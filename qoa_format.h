@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_FORMAT_H_
+#define AUDIO_QOA_FORMAT_H_
+
+#include "qoa.h"
+#include "qoa_endian.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// The byte layout of QOA files, for code that works on encoded frames
+// directly instead of through Decoder, e.g. to copy slices between files.
+
+inline constexpr std::size_t kFileHeaderSize = 8;
+inline constexpr std::size_t kFrameHeaderSize = 8;
+inline constexpr std::size_t kLmsStateSize = 16;
+inline constexpr std::size_t kSliceSize = 8;
+
+// Of a frame with `slices` slices per channel, headers included.
+constexpr std::size_t frame_size(std::size_t channels, std::size_t slices) {
+    return kFrameHeaderSize + kLmsStateSize * channels + kSliceSize * slices * channels;
+}
+
+// [1] The scale factor is dequantized as round(pow(sf_quant + 1, 2.75)).
+inline constexpr std::array<int, 16> kScaleFactorTable{
+        1, 7, 21, 45, 84, 138, 211, 304, 421, 562, 731, 928, 1157, 1419, 1715, 2048};
+
+// The dequantized scale factor in the top 4 bits of a slice.
+constexpr int slice_scale_factor(std::uint8_t const *slice) {
+    return kScaleFactorTable[slice[0] >> 4];
+}
+
+// One channel's LmsState as stored after the frame header.
+inline LmsState parse_lms_state(std::uint8_t const *data) {
+    LmsState s{};
+    for (std::size_t i = 0; i < 4; ++i) {
+        s.history[i] = load_be<std::int16_t>(data + i * 2);
+        s.weights[i] = load_be<std::int16_t>(data + 8 + i * 2);
+    }
+
+    return s;
+}
+
+inline void store_lms_state(std::uint8_t *data, LmsState const &s) {
+    for (std::size_t i = 0; i < 4; ++i) {
+        store_be(data + i * 2, static_cast<std::int16_t>(s.history[i]));
+        store_be(data + 8 + i * 2, static_cast<std::int16_t>(s.weights[i]));
+    }
+}
+
+// "qoaf" and the samples per channel, 0 for streams.
+inline void append_file_header(std::vector<std::uint8_t> &out, std::uint32_t sample_count) {
+    out.resize(out.size() + kFileHeaderSize);
+    auto *data = &out[out.size() - kFileHeaderSize];
+    std::memcpy(data, "qoaf", 4);
+    store_be(data + 4, sample_count);
+}
+
+// The header of a frame of `samples` samples per channel, followed by the
+// LmsState each channel starts it from.
+inline void append_frame_header(
+        std::vector<std::uint8_t> &out, std::uint32_t sample_rate, std::size_t samples, std::span<LmsState const> lms) {
+    auto const channels = lms.size();
+    auto const size = kFrameHeaderSize + kLmsStateSize * channels;
+    out.resize(out.size() + size);
+    auto *data = &out[out.size() - size];
+    data[0] = static_cast<std::uint8_t>(channels);
+    store_be24(data + 1, sample_rate);
+    store_be(data + 4, static_cast<std::uint16_t>(samples));
+    store_be(data + 6, static_cast<std::uint16_t>(frame_size(channels, (samples + kSliceLen - 1) / kSliceLen)));
+    data += kFrameHeaderSize;
+    for (auto const &s : lms) {
+        store_lms_state(data, s);
+        data += kLmsStateSize;
+    }
+}
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_frame_pool.h"
+
+#include "qoa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace qoa {
+namespace {
+
+constexpr std::size_t kCacheLine = 64;
+constexpr std::uint32_t kNone = std::numeric_limits<std::uint32_t>::max();
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+constexpr std::uint64_t pack(std::uint64_t tag, std::uint32_t index) {
+  return tag << 32 | index;
+}
+
+} // namespace
+
+FrameBuffer::FrameBuffer(FrameBuffer const &other) noexcept
+    : pool_{other.pool_}, index_{other.index_} {
+  if (pool_ != nullptr) {
+    pool_->slots_[index_].refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+FrameBuffer::FrameBuffer(FrameBuffer &&other) noexcept
+    : pool_{std::exchange(other.pool_, nullptr)}, index_{other.index_} {}
+
+FrameBuffer &FrameBuffer::operator=(FrameBuffer other) noexcept {
+  std::swap(pool_, other.pool_);
+  std::swap(index_, other.index_);
+  return *this;
+}
+
+FrameBuffer::~FrameBuffer() {
+  if (pool_ != nullptr) {
+    pool_->release(index_);
+  }
+}
+
+std::span<std::int16_t> FrameBuffer::samples() const {
+  if (pool_ == nullptr) {
+    return {};
+  }
+
+  return {pool_->samples_.get() + pool_->stride_ * index_,
+          kFrameLen * pool_->channels_};
+}
+
+void FramePool::AlignedDelete::operator()(std::int16_t *p) const noexcept {
+  ::operator delete[](p, std::align_val_t{kCacheLine});
+}
+
+FramePool::FramePool(std::size_t buffers, std::size_t channels)
+    : channels_{channels},
+      stride_{(kFrameLen * channels * sizeof(std::int16_t) + kCacheLine - 1) /
+              kCacheLine * kCacheLine / sizeof(std::int16_t)},
+      slots_(std::min<std::size_t>(buffers, kNone)) {
+  samples_.reset(static_cast<std::int16_t *>(::operator new[](
+      stride_ * slots_.size() * sizeof(std::int16_t),
+      std::align_val_t{kCacheLine})));
+
+  for (std::size_t i = 0; i < slots_.size(); ++i) {
+    auto const next =
+        i + 1 < slots_.size() ? static_cast<std::uint32_t>(i + 1) : kNone;
+    slots_[i].next.store(next, std::memory_order_relaxed);
+  }
+  free_.store(pack(0, slots_.empty() ? kNone : 0), std::memory_order_release);
+}
+
+std::optional<FrameBuffer> FramePool::acquire() noexcept {
+  auto head = free_.load(std::memory_order_acquire);
+  while (true) {
+    auto const index = static_cast<std::uint32_t>(head);
+    if (index == kNone) {
+      return std::nullopt;
+    }
+
+    // If another thread takes this buffer first, `next` may be stale, but
+    // then the tag has changed and the exchange fails.
+    auto const next = slots_[index].next.load(std::memory_order_relaxed);
+    if (free_.compare_exchange_weak(head, pack((head >> 32) + 1, next),
+                                    std::memory_order_acquire,
+                                    std::memory_order_acquire)) {
+      slots_[index].refs.store(1, std::memory_order_relaxed);
+      return FrameBuffer{this, index};
+    }
+  }
+}
+
+void FramePool::release(std::uint32_t index) noexcept {
+  // The last owner has to see everything the others wrote before the buffer
+  // is handed out again.
+  if (slots_[index].refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  auto head = free_.load(std::memory_order_relaxed);
+  do {
+    slots_[index].next.store(static_cast<std::uint32_t>(head),
+                             std::memory_order_relaxed);
+  } while (!free_.compare_exchange_weak(head, pack((head >> 32) + 1, index),
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed));
+}
+
+} // namespace qoa
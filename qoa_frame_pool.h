@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_FRAME_POOL_H_
+#define AUDIO_QOA_FRAME_POOL_H_
+
+#include "qoa.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+class FramePool;
+
+// Shared ownership of one of a FramePool's buffers. Copies refer to the same
+// buffer, which goes back to the pool when the last of them is destroyed, so
+// a decoder can hand a frame to any number of consumers and forget about it.
+class FrameBuffer {
+public:
+    FrameBuffer() = default;
+    FrameBuffer(FrameBuffer const &) noexcept;
+    FrameBuffer(FrameBuffer &&) noexcept;
+    FrameBuffer &operator=(FrameBuffer) noexcept;
+    ~FrameBuffer();
+
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    // Room for kFrameLen samples of as many channels as the pool was made
+    // for, aligned to a cache line, e.g. for Decoder::decode_frame().
+    std::span<std::int16_t> samples() const;
+
+private:
+    friend FramePool;
+    FrameBuffer(FramePool *pool, std::uint32_t index) : pool_{pool}, index_{index} {}
+
+    FramePool *pool_{};
+    std::uint32_t index_{};
+};
+
+// Fixed number of frame buffers allocated up front and shared by any number
+// of decoders on any threads. Taking and returning buffers is lock-free and
+// never allocates, so streams can come and go without touching the heap.
+//
+// The pool has to outlive every FrameBuffer taken from it.
+class FramePool {
+public:
+    explicit FramePool(std::size_t buffers, std::size_t channels = kMaxChannels);
+
+    FramePool(FramePool const &) = delete;
+    FramePool &operator=(FramePool const &) = delete;
+
+    // Returns nullopt if every buffer is in use.
+    std::optional<FrameBuffer> acquire() noexcept;
+
+    std::size_t size() const { return slots_.size(); }
+    std::size_t nbr_channels() const { return channels_; }
+
+private:
+    friend FrameBuffer;
+
+    // One per cache line so the reference counts of buffers used by
+    // different threads don't share one.
+    struct alignas(64) Slot {
+        std::atomic<std::uint32_t> refs{};
+        // The free buffer after this one, if this one is free.
+        std::atomic<std::uint32_t> next{};
+    };
+
+    struct AlignedDelete {
+        void operator()(std::int16_t *) const noexcept;
+    };
+
+    void release(std::uint32_t index) noexcept;
+
+    std::size_t channels_{};
+    // Samples from one buffer to the next, rounded up to a whole cache line.
+    std::size_t stride_{};
+    std::unique_ptr<std::int16_t[], AlignedDelete> samples_;
+    std::vector<Slot> slots_;
+    // The first free buffer in the low 32 bits, and a count of changes in the
+    // high ones so a buffer that's taken and put back in between isn't
+    // mistaken for nothing having changed.
+    std::atomic<std::uint64_t> free_{};
+};
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_GENERATOR_H_
+#define AUDIO_QOA_GENERATOR_H_
+
+#include <coroutine>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+namespace qoa {
+
+// Lazily evaluated input range of the values a coroutine co_yields, standing
+// in for std::generator until the standard libraries we build with have it.
+//
+// Nothing runs until begin() is called, and every increment resumes the
+// coroutine until its next co_yield. Yielded values are only referenced, so
+// they are valid until the iterator is incremented. It's a single-pass range:
+// begin() may only be called once.
+template <typename T>
+class Generator : public std::ranges::view_interface<Generator<T>> {
+public:
+    struct promise_type {
+        T const *value{};
+
+        Generator get_return_object() { return Generator{Handle::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T const &v) noexcept {
+            value = std::addressof(v);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; }
+
+        // Only co_yield makes sense in a generator.
+        template <typename U>
+        std::suspend_never await_transform(U &&) = delete;
+    };
+
+    class Iterator {
+    public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        T const &operator*() const { return *handle_.promise().value; }
+        Iterator &operator++() {
+            handle_.resume();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(Iterator const &it, std::default_sentinel_t) { return !it.handle_ || it.handle_.done(); }
+
+    private:
+        friend Generator;
+        explicit Iterator(std::coroutine_handle<promise_type> handle) : handle_{handle} {}
+
+        std::coroutine_handle<promise_type> handle_{};
+    };
+
+    Generator(Generator &&other) noexcept : handle_{std::exchange(other.handle_, {})} {}
+    Generator &operator=(Generator &&other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    ~Generator() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    Iterator begin() {
+        handle_.resume();
+        return Iterator{handle_};
+    }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Generator(Handle handle) : handle_{handle} {}
+
+    Handle handle_{};
+};
+
+} // namespace qoa
+
+#endif
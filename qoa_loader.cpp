@@ -0,0 +1,273 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_loader.h"
+
+#include "qoa.h"
+#include "qoa_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <semaphore>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef QOA_HAVE_LIBURING
+#include <cerrno>
+#include <liburing.h>
+#endif
+
+namespace qoa {
+namespace {
+
+// Bounds how many file buffers are alive at once. Taken before a read is
+// started and given back once its buffer has been decoded.
+using Slots = std::counting_semaphore<>;
+
+struct Load {
+  std::span<std::string const> paths;
+  std::vector<std::optional<Qoa>> &results;
+  ThreadPool &decoders;
+  Slots &slots;
+
+  void decode(std::size_t index, std::vector<std::uint8_t> data) {
+    decoders.submit([this, index, data = std::move(data)] {
+      results[index] = Qoa::parse(data);
+      slots.release();
+    });
+  }
+};
+
+#ifndef _WIN32
+std::optional<std::size_t> file_size(int fd) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size < 0) {
+    return std::nullopt;
+  }
+
+  return static_cast<std::size_t>(st.st_size);
+}
+#endif
+
+std::optional<std::vector<std::uint8_t>> read_file(std::string const &path) {
+#ifdef _WIN32
+  std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+  if (!fs.seekg(0, std::ios::end)) {
+    return std::nullopt;
+  }
+
+  std::vector<std::uint8_t> data(static_cast<std::size_t>(fs.tellg()));
+  fs.seekg(0);
+  if (!fs.read(reinterpret_cast<char *>(data.data()),
+               static_cast<std::streamsize>(data.size()))) {
+    return std::nullopt;
+  }
+
+  return data;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  std::optional<std::vector<std::uint8_t>> data;
+  if (auto size = file_size(fd)) {
+    data.emplace(*size);
+    std::size_t done = 0;
+    while (done < data->size()) {
+      auto const r = ::pread(fd, data->data() + done, data->size() - done,
+                             static_cast<off_t>(done));
+      if (r <= 0) {
+        data.reset();
+        break;
+      }
+      done += static_cast<std::size_t>(r);
+    }
+  }
+
+  ::close(fd);
+  return data;
+#endif
+}
+
+// Each reader takes the next file nobody has started on yet, so one slow file
+// doesn't hold up the others.
+void load_with_threads(Load &load, std::size_t io_threads) {
+  std::atomic<std::size_t> next{0};
+  ThreadPool readers{std::min(io_threads, load.paths.size())};
+  for (std::size_t i = 0; i < readers.size(); ++i) {
+    readers.submit([&] {
+      for (auto index = next++; index < load.paths.size(); index = next++) {
+        load.slots.acquire();
+        if (auto data = read_file(load.paths[index])) {
+          load.decode(index, *std::move(data));
+        } else {
+          load.slots.release();
+        }
+      }
+    });
+  }
+  readers.wait();
+}
+
+#ifdef QOA_HAVE_LIBURING
+struct PendingRead {
+  std::size_t index{};
+  int fd{-1};
+  std::vector<std::uint8_t> data;
+  std::size_t done{};
+};
+
+void queue_read(io_uring &ring, PendingRead *read) {
+  auto *sqe = io_uring_get_sqe(&ring);
+  io_uring_prep_read(sqe, read->fd, read->data.data() + read->done,
+                     static_cast<unsigned>(read->data.size() - read->done),
+                     read->done);
+  io_uring_sqe_set_data(sqe, read);
+}
+
+// Keeps up to `depth` reads in flight on a single thread and hands each file
+// to the decoders as soon as its last read completes. Returns false without
+// having read anything if the kernel doesn't support io_uring.
+bool load_with_io_uring(Load &load, unsigned depth) {
+  io_uring ring{};
+  if (io_uring_queue_init(depth, &ring, 0) < 0) {
+    return false;
+  }
+
+  std::size_t next = 0;
+  std::size_t in_flight = 0;
+  while (next < load.paths.size() || in_flight > 0) {
+    while (next < load.paths.size() && in_flight < depth) {
+      // Only block on the decoders when there's nothing else to wait for, or
+      // we'd never get around to reaping the reads that are in flight.
+      if (in_flight == 0) {
+        load.slots.acquire();
+      } else if (!load.slots.try_acquire()) {
+        break;
+      }
+
+      auto const index = next++;
+      int fd = ::open(load.paths[index].c_str(), O_RDONLY);
+      auto size = fd < 0 ? std::nullopt : file_size(fd);
+      if (!size || *size == 0) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+        load.slots.release();
+        continue;
+      }
+
+      auto read = std::make_unique<PendingRead>(
+          PendingRead{.index = index, .fd = fd, .data = {}, .done = 0});
+      read->data.resize(*size);
+      queue_read(ring, read.release());
+      ++in_flight;
+    }
+
+    io_uring_submit(&ring);
+    if (in_flight == 0) {
+      continue;
+    }
+
+    io_uring_cqe *cqe{};
+    if (io_uring_wait_cqe(&ring, &cqe) < 0) {
+      continue;
+    }
+
+    do {
+      std::unique_ptr<PendingRead> read{
+          static_cast<PendingRead *>(io_uring_cqe_get_data(cqe))};
+      auto const res = cqe->res;
+      io_uring_cqe_seen(&ring, cqe);
+
+      if (res == -EINTR || res == -EAGAIN) {
+        queue_read(ring, read.release());
+        continue;
+      }
+
+      if (res > 0) {
+        read->done += static_cast<std::size_t>(res);
+        // Short read, ask for the rest.
+        if (read->done < read->data.size()) {
+          queue_read(ring, read.release());
+          continue;
+        }
+      }
+
+      --in_flight;
+      ::close(read->fd);
+      if (res > 0) {
+        load.decode(read->index, std::move(read->data));
+      } else {
+        load.slots.release();
+      }
+    } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+  }
+
+  io_uring_queue_exit(&ring);
+  return true;
+}
+#endif
+
+} // namespace
+
+bool io_uring_available() {
+#ifdef QOA_HAVE_LIBURING
+  io_uring ring{};
+  if (io_uring_queue_init(1, &ring, 0) < 0) {
+    return false;
+  }
+
+  io_uring_queue_exit(&ring);
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<std::optional<Qoa>> load_files(std::span<std::string const> paths,
+                                           LoaderOptions const &options) {
+  std::vector<std::optional<Qoa>> results(paths.size());
+  if (paths.empty()) {
+    return results;
+  }
+
+  auto const depth = std::max<std::size_t>(options.queue_depth, 1);
+  Slots slots{static_cast<std::ptrdiff_t>(depth)};
+  // Destroyed before the slots, finishing the last decodes.
+  ThreadPool decoders{options.decode_threads};
+  Load load{.paths = paths,
+            .results = results,
+            .decoders = decoders,
+            .slots = slots};
+
+#ifdef QOA_HAVE_LIBURING
+  if (options.use_io_uring &&
+      load_with_io_uring(load, static_cast<unsigned>(depth))) {
+    decoders.wait();
+    return results;
+  }
+#endif
+
+  load_with_threads(load, std::max<std::size_t>(options.io_threads, 1));
+  decoders.wait();
+  return results;
+}
+
+} // namespace qoa
@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_LOADER_H_
+#define AUDIO_QOA_LOADER_H_
+
+#include "qoa.h"
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace qoa {
+
+struct LoaderOptions {
+    // Files being read, or read and waiting to be decoded, at once.
+    std::size_t queue_depth{64};
+    // 0 means one per hardware thread.
+    std::size_t decode_threads{0};
+    // Only used when io_uring isn't.
+    std::size_t io_threads{4};
+    bool use_io_uring{true};
+};
+
+// Whether load_files() can use io_uring in this build and on this system.
+bool io_uring_available();
+
+// Reads and decodes all the files, decoding each one as soon as it's been
+// read so file I/O and decoding overlap. Reads go through io_uring when it's
+// available and requested, and otherwise through a pool of threads doing
+// blocking reads. Results are in the same order as `paths`, with nullopt for
+// files that couldn't be read or decoded.
+std::vector<std::optional<Qoa>> load_files(std::span<std::string const> paths, LoaderOptions const & = {});
+
+} // namespace qoa
+
+#endif
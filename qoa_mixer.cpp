@@ -0,0 +1,198 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_mixer.h"
+
+#include "qoa.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QOA_MIXER_SSE2 1
+#endif
+
+namespace qoa {
+namespace {
+
+// Samples per channel decoded per voice at a time. A multiple of the slice
+// length so the decoder rarely has to go through its slice buffer.
+constexpr std::size_t kBlockLen = 16 * kSliceLen;
+
+constexpr float kSampleScale = 1.f / 32768.f;
+
+#ifdef QOA_MIXER_SSE2
+// Sign-extends the low or high four int16s of `s` to floats.
+__m128 low_to_float(__m128i s) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+}
+
+__m128 high_to_float(__m128i s) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+}
+
+void add_scaled(float *dst, __m128 v, __m128 gains) {
+  _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(v, gains)));
+}
+#endif
+
+// Adds `frames` mono samples to the stereo bus.
+void accumulate_mono(float *bus, std::int16_t const *in, std::size_t frames,
+                     float gain_l, float gain_r) {
+  std::size_t i = 0;
+#ifdef QOA_MIXER_SSE2
+  auto const gains = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 8 <= frames; i += 8) {
+    auto const s =
+        _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+    auto const lo = low_to_float(s);
+    auto const hi = high_to_float(s);
+    std::array const lr{
+        _mm_unpacklo_ps(lo, lo),
+        _mm_unpackhi_ps(lo, lo),
+        _mm_unpacklo_ps(hi, hi),
+        _mm_unpackhi_ps(hi, hi),
+    };
+    for (std::size_t j = 0; j < lr.size(); ++j) {
+      add_scaled(bus + 2 * i + 4 * j, lr[j], gains);
+    }
+  }
+#endif
+  for (; i < frames; ++i) {
+    bus[2 * i] += static_cast<float>(in[i]) * gain_l;
+    bus[2 * i + 1] += static_cast<float>(in[i]) * gain_r;
+  }
+}
+
+// Adds `frames` interleaved stereo samples to the stereo bus.
+void accumulate_stereo(float *bus, std::int16_t const *in, std::size_t frames,
+                       float gain_l, float gain_r) {
+  std::size_t i = 0;
+#ifdef QOA_MIXER_SSE2
+  auto const gains = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frames; i += 4) {
+    auto const s =
+        _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 2 * i));
+    add_scaled(bus + 2 * i, low_to_float(s), gains);
+    add_scaled(bus + 2 * i + 4, high_to_float(s), gains);
+  }
+#endif
+  for (; i < frames; ++i) {
+    bus[2 * i] += static_cast<float>(in[2 * i]) * gain_l;
+    bus[2 * i + 1] += static_cast<float>(in[2 * i + 1]) * gain_r;
+  }
+}
+
+} // namespace
+
+Mixer::Mixer(std::size_t max_voices) : voices_(max_voices) {}
+
+std::optional<Mixer::Voice> Mixer::play(std::span<std::uint8_t const> data,
+                                        float gain, float pan) {
+  auto decoder = Decoder::parse(data);
+  if (!decoder || decoder->nbr_channels() > 2) {
+    return std::nullopt;
+  }
+
+  auto it = std::ranges::find_if(
+      voices_, [](VoiceState const &v) { return !v.decoder.has_value(); });
+  if (it == voices_.end()) {
+    return std::nullopt;
+  }
+
+  it->decoder = *std::move(decoder);
+  it->gain = gain;
+  it->pan = pan;
+  return Voice{
+      .index = static_cast<std::uint32_t>(it - voices_.begin()),
+      .generation = it->generation,
+  };
+}
+
+void Mixer::stop(Voice voice) {
+  if (auto *v = find(voice)) {
+    v->decoder.reset();
+    ++v->generation;
+  }
+}
+
+bool Mixer::playing(Voice voice) const { return find(voice) != nullptr; }
+
+void Mixer::set_gain(Voice voice, float gain) {
+  if (auto *v = find(voice)) {
+    v->gain = gain;
+  }
+}
+
+void Mixer::set_pan(Voice voice, float pan) {
+  if (auto *v = find(voice)) {
+    v->pan = pan;
+  }
+}
+
+void Mixer::mix(std::span<float> out) {
+  std::ranges::fill(out, 0.f);
+  for (auto &voice : voices_) {
+    if (voice.decoder) {
+      mix_voice(voice, out);
+    }
+  }
+}
+
+Mixer::VoiceState *Mixer::find(Voice voice) {
+  return const_cast<VoiceState *>(std::as_const(*this).find(voice));
+}
+
+Mixer::VoiceState const *Mixer::find(Voice voice) const {
+  if (voice.index >= voices_.size()) {
+    return nullptr;
+  }
+
+  auto const &v = voices_[voice.index];
+  if (!v.decoder || v.generation != voice.generation) {
+    return nullptr;
+  }
+
+  return &v;
+}
+
+void Mixer::mix_voice(VoiceState &voice, std::span<float> out) {
+  // Constant-power panning.
+  auto const angle = (std::clamp(voice.pan, -1.f, 1.f) + 1.f) *
+                     std::numbers::pi_v<float> / 4.f;
+  auto const gain_l = std::cos(angle) * voice.gain * kSampleScale;
+  auto const gain_r = std::sin(angle) * voice.gain * kSampleScale;
+
+  auto &decoder = *voice.decoder;
+  auto const channels = decoder.nbr_channels();
+  std::array<std::int16_t, kBlockLen * 2> block;
+  std::size_t const frames = out.size() / 2;
+  for (std::size_t done = 0; done < frames;) {
+    auto const wanted = std::min(kBlockLen, frames - done);
+    auto const decoded =
+        decoder.decode(std::span{block}.first(wanted * channels));
+    if (channels == 1) {
+      accumulate_mono(&out[2 * done], block.data(), decoded, gain_l, gain_r);
+    } else {
+      accumulate_stereo(&out[2 * done], block.data(), decoded, gain_l, gain_r);
+    }
+
+    done += decoded;
+    if (decoded < wanted) {
+      voice.decoder.reset();
+      ++voice.generation;
+      return;
+    }
+  }
+}
+
+} // namespace qoa
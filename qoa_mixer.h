@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_MIXER_H_
+#define AUDIO_QOA_MIXER_H_
+
+#include "qoa.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// Mixes many QOA voices into a stereo float bus, decoding each voice a few
+// slices at a time right before it's needed. Voices only keep their
+// compressed data and a Decoder around, so memory stays at the compressed
+// size instead of that of the fully decoded audio.
+//
+// Voices are mixed as-is, so they should match the output sample rate.
+// Only mono and stereo voices are supported. Nothing past the constructor
+// allocates.
+class Mixer {
+public:
+    struct Voice {
+        std::uint32_t index{};
+        std::uint32_t generation{};
+    };
+
+    explicit Mixer(std::size_t max_voices);
+
+    // Starts playing `data`, which has to outlive the voice. Pan goes from
+    // -1 (left) to 1 (right). Returns nullopt if the data can't be decoded
+    // or every voice is already in use.
+    std::optional<Voice> play(std::span<std::uint8_t const> data, float gain = 1.f, float pan = 0.f);
+    void stop(Voice);
+    bool playing(Voice) const;
+    void set_gain(Voice, float gain);
+    void set_pan(Voice, float pan);
+
+    // Overwrites `out` with the interleaved stereo mix of all playing voices.
+    // Voices that run out of data stop by themselves.
+    void mix(std::span<float> out);
+
+private:
+    struct VoiceState {
+        std::optional<Decoder> decoder{};
+        std::uint32_t generation{};
+        float gain{};
+        float pan{};
+    };
+
+    VoiceState *find(Voice);
+    VoiceState const *find(Voice) const;
+    void mix_voice(VoiceState &, std::span<float> out);
+
+    std::vector<VoiceState> voices_;
+};
+
+} // namespace qoa
+
+#endif
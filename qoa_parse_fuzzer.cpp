@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <span>
+#include <sstream>
+#include <string>
+
+// Decodes untrusted input with the limits set and aborts if any input makes
+// the decoders allocate more for their output than max_memory, decode more
+// than max_samples, or take longer than kTimeLimit.
+namespace {
+
+constexpr std::size_t kMaxMemory = 1 << 20;
+constexpr std::uint64_t kMaxSamples = 1 << 18;
+// Far more than decoding max_samples of any channel count takes, even with
+// sanitizers. Input that gets close is spending its time on something else.
+constexpr auto kTimeLimit = std::chrono::seconds{1};
+
+// Keeps track of the largest allocation made through it.
+class LargestAllocation : public std::pmr::memory_resource {
+public:
+    std::size_t bytes() const { return largest_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        largest_ = std::max(largest_, bytes);
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+
+    std::size_t largest_{};
+};
+
+void check(bool ok, char const *what) {
+    if (!ok) {
+        std::fprintf(stderr, "%s\n", what);
+        std::abort();
+    }
+}
+
+template <typename Parse>
+void check_limits(Parse parse, qoa::DecodeOptions const &options) {
+    LargestAllocation resource;
+    auto const start = std::chrono::steady_clock::now();
+    auto const qoa = parse(options, std::pmr::polymorphic_allocator<std::int16_t>{&resource});
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    check(resource.bytes() <= options.max_memory, "The output went past max_memory");
+    check(elapsed < kTimeLimit, "Decoding took too long");
+    if (qoa) {
+        check(options.allows(qoa->audio_frames.size() / qoa->nbr_channels, qoa->nbr_channels),
+                "The output went past the limits");
+    }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const *, std::size_t);
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const *data, std::size_t size) {
+    std::span<std::uint8_t const> const file{data, size};
+    for (auto validation : {qoa::Validation::Trusted, qoa::Validation::Frame, qoa::Validation::Strict}) {
+        qoa::DecodeOptions const options{
+                .validation = validation,
+                .max_samples = kMaxSamples,
+                .max_memory = kMaxMemory,
+        };
+
+        check_limits([&](auto const &o, auto const &alloc) { return qoa::pmr::Qoa::parse(file, o, alloc); }, options);
+        check_limits(
+                [&](auto const &o, auto const &alloc) {
+                    std::string const bytes{reinterpret_cast<char const *>(data), size};
+                    return qoa::pmr::Qoa::parse(std::istringstream{bytes}, o, alloc);
+                },
+                options);
+    }
+
+    return 0;
+}
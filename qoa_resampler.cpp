@@ -0,0 +1,214 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_resampler.h"
+
+#include "qoa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QOA_RESAMPLER_SSE2 1
+#endif
+
+namespace qoa {
+namespace {
+
+constexpr std::size_t kSincTaps = 32;
+constexpr std::size_t kMaxSincPhases = 1024;
+// Where the sinc filter's passband ends, relative to the lower of the two
+// Nyquist frequencies.
+constexpr double kSincRolloff = 0.95;
+
+constexpr float kSampleScale = 1.f / 32768.f;
+
+template <std::size_t N> float dot(float const *a, float const *b) {
+  static_assert(N % 4 == 0);
+#ifdef QOA_RESAMPLER_SSE2
+  auto acc = _mm_setzero_ps();
+  for (std::size_t i = 0; i < N; i += 4) {
+    acc =
+        _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+  return _mm_cvtss_f32(acc);
+#else
+  float sum = 0.f;
+  for (std::size_t i = 0; i < N; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+#endif
+}
+
+// Blackman-windowed sinc, one row of kSincTaps coefficients per phase.
+std::vector<float> make_sinc_filter(std::size_t phases, double cutoff) {
+  constexpr double kPi = std::numbers::pi;
+  constexpr double kHalfWidth = kSincTaps / 2;
+  std::vector<float> filter(phases * kSincTaps);
+  for (std::size_t p = 0; p < phases; ++p) {
+    auto row = std::span{filter}.subspan(p * kSincTaps, kSincTaps);
+    double sum = 0;
+    for (std::size_t j = 0; j < kSincTaps; ++j) {
+      // Distance in input samples from the point being interpolated.
+      double const x = static_cast<double>(j) - (kHalfWidth - 1) -
+                       static_cast<double>(p) / static_cast<double>(phases);
+      double const sinc =
+          x == 0 ? 1 : std::sin(kPi * cutoff * x) / (kPi * cutoff * x);
+      double const window = 0.42 + 0.5 * std::cos(kPi * x / kHalfWidth) +
+                            0.08 * std::cos(2 * kPi * x / kHalfWidth);
+      double const h = cutoff * sinc * window;
+      row[j] = static_cast<float>(h);
+      sum += h;
+    }
+
+    // Normalize each phase to unity gain so there's no ripple at DC.
+    for (auto &h : row) {
+      h = static_cast<float>(static_cast<double>(h) / sum);
+    }
+  }
+
+  return filter;
+}
+
+} // namespace
+
+std::optional<Resampler> Resampler::create(std::uint32_t in_rate,
+                                           std::uint32_t out_rate,
+                                           std::uint32_t nbr_channels,
+                                           Quality quality) {
+  if (in_rate == 0 || out_rate == 0 || nbr_channels == 0) {
+    return std::nullopt;
+  }
+
+  return Resampler{in_rate, out_rate, nbr_channels, quality};
+}
+
+Resampler::Resampler(std::uint32_t in_rate, std::uint32_t out_rate,
+                     std::uint32_t nbr_channels, Quality quality)
+    : in_rate_{in_rate}, out_rate_{out_rate}, channels_{nbr_channels},
+      quality_{quality} {
+  switch (quality_) {
+  case Quality::Linear:
+    before_ = 0;
+    after_ = 1;
+    break;
+  case Quality::Cubic:
+    before_ = 1;
+    after_ = 2;
+    break;
+  case Quality::Sinc: {
+    before_ = kSincTaps / 2 - 1;
+    after_ = kSincTaps / 2;
+    // Every position the output lands on is a multiple of 1 / (out / gcd)
+    // input samples, so that many phases are exact.
+    filter_phases_ =
+        std::min<std::size_t>(out_rate_ / std::gcd(in_rate_, out_rate_),
+                              kMaxSincPhases);
+    auto const cutoff =
+        std::min(1.0, static_cast<double>(out_rate_) / in_rate_) *
+        kSincRolloff;
+    filter_ = make_sinc_filter(filter_phases_, cutoff);
+    break;
+  }
+  }
+
+  input_.resize(channels_);
+  for (auto &ch : input_) {
+    ch.reserve(before_ + after_ + kFrameLen);
+    ch.resize(before_);
+  }
+  pos_ = before_;
+}
+
+std::size_t Resampler::max_output(std::size_t in_frames) const {
+  auto const buffered = input_.empty() ? 0 : input_[0].size();
+  auto const available =
+      buffered + in_frames + after_ - std::min(pos_, buffered);
+  return available * out_rate_ / in_rate_ + 1;
+}
+
+std::size_t Resampler::process(std::span<std::int16_t const> in,
+                               std::span<float> out) {
+  auto const frames = in.size() / channels_;
+  for (std::size_t ch = 0; ch < channels_; ++ch) {
+    auto &buffer = input_[ch];
+    auto const start = buffer.size();
+    buffer.resize(start + frames);
+    for (std::size_t i = 0; i < frames; ++i) {
+      buffer[start + i] =
+          static_cast<float>(in[i * channels_ + ch]) * kSampleScale;
+    }
+  }
+
+  return drain(out);
+}
+
+std::size_t Resampler::flush(std::span<float> out) {
+  for (auto &buffer : input_) {
+    buffer.resize(buffer.size() + after_);
+  }
+
+  return drain(out);
+}
+
+float Resampler::interpolate(float const *at, std::size_t phase) const {
+  switch (quality_) {
+  case Quality::Linear: {
+    auto const t = static_cast<float>(phase) / static_cast<float>(out_rate_);
+    return at[0] + (at[1] - at[0]) * t;
+  }
+  case Quality::Cubic: {
+    // Catmull-Rom.
+    auto const t = static_cast<float>(phase) / static_cast<float>(out_rate_);
+    auto const a = -.5f * at[-1] + 1.5f * at[0] - 1.5f * at[1] + .5f * at[2];
+    auto const b = at[-1] - 2.5f * at[0] + 2.f * at[1] - .5f * at[2];
+    auto const c = -.5f * at[-1] + .5f * at[1];
+    return ((a * t + b) * t + c) * t + at[0];
+  }
+  case Quality::Sinc: {
+    auto const row = phase * filter_phases_ / out_rate_;
+    return dot<kSincTaps>(at - before_, &filter_[row * kSincTaps]);
+  }
+  }
+
+  return 0.f;
+}
+
+std::size_t Resampler::drain(std::span<float> out) {
+  auto const max = out.size() / channels_;
+  auto const available = input_[0].size();
+  std::size_t written = 0;
+  for (; written < max && pos_ + after_ < available; ++written) {
+    for (std::size_t ch = 0; ch < channels_; ++ch) {
+      out[written * channels_ + ch] =
+          interpolate(&input_[ch][pos_], static_cast<std::size_t>(phase_));
+    }
+
+    phase_ += in_rate_;
+    pos_ += static_cast<std::size_t>(phase_ / out_rate_);
+    phase_ %= out_rate_;
+  }
+
+  // Only keep what the next output still needs to look back at.
+  auto const consumed = std::min(pos_ - before_, available);
+  for (auto &buffer : input_) {
+    buffer.erase(buffer.begin(),
+                 buffer.begin() + static_cast<std::ptrdiff_t>(consumed));
+  }
+  pos_ -= consumed;
+  return written;
+}
+
+} // namespace qoa
@@ -0,0 +1,70 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_RESAMPLER_H_
+#define AUDIO_QOA_RESAMPLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// Converts interleaved int16 audio to interleaved float audio at another
+// sample rate. Input is fed a piece at a time, e.g. one Decoder::decode_frame
+// at a time, and the resampler keeps whatever it still needs from earlier
+// pieces, so a file never has to be decoded in full at its source rate.
+class Resampler {
+public:
+    enum class Quality {
+        Linear,
+        Cubic,
+        // Windowed-sinc polyphase filter.
+        Sinc,
+    };
+
+    // Fails if either rate or the channel count is 0.
+    static std::optional<Resampler> create(
+            std::uint32_t in_rate, std::uint32_t out_rate, std::uint32_t nbr_channels, Quality);
+
+    // The most frames process() can produce after being given `in_frames`
+    // more frames.
+    std::size_t max_output(std::size_t in_frames) const;
+
+    // Returns the number of frames written to `out`. Output that doesn't fit
+    // is held back until the next call.
+    std::size_t process(std::span<std::int16_t const> in, std::span<float> out);
+
+    // Pushes out what's held back for lookahead at the end of the input.
+    std::size_t flush(std::span<float> out);
+
+private:
+    Resampler(std::uint32_t in_rate, std::uint32_t out_rate, std::uint32_t nbr_channels, Quality);
+
+    float interpolate(float const *at, std::size_t phase) const;
+    std::size_t drain(std::span<float> out);
+
+    std::uint32_t in_rate_{};
+    std::uint32_t out_rate_{};
+    std::uint32_t channels_{};
+    Quality quality_{};
+
+    // Samples needed before and after the interpolation point.
+    std::size_t before_{};
+    std::size_t after_{};
+
+    // Planar float input, with the read position pos_ + phase_ / out_rate_.
+    std::vector<std::vector<float>> input_;
+    std::size_t pos_{};
+    std::uint64_t phase_{};
+
+    std::size_t filter_phases_{};
+    std::vector<float> filter_{};
+};
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_THREAD_POOL_H_
+#define AUDIO_QOA_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qoa {
+
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread.
+    explicit ThreadPool(std::size_t threads = 0);
+    // Finishes all submitted work before returning.
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    std::size_t size() const { return threads_.size(); }
+
+    void submit(std::function<void()>);
+    // Blocks until everything submitted so far has run.
+    void wait();
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable idle_;
+    std::deque<std::function<void()>> queue_;
+    std::size_t busy_{};
+    bool stopping_{};
+    std::vector<std::thread> threads_;
+};
+
+} // namespace qoa
+
+#endif
@@ -0,0 +1,380 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_transcoder.h"
+
+#include "qoa.h"
+#include "qoa_bounded_queue.h"
+#include "qoa_endian.h"
+#include "qoa_resampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace qoa {
+namespace {
+
+constexpr std::size_t kWavHeaderSize = 44;
+constexpr float kSampleScale = 1.f / 32768.f;
+// Decoded frames waiting between the decode and convert stages, per file.
+constexpr std::size_t kFramesInFlight = 4;
+
+struct ReadFile {
+  std::size_t job{};
+  std::vector<std::uint8_t> data;
+};
+
+// The frames of a file on their way from the decode stage to the convert
+// stage. Either side closes the queue when it stops early, which lets the
+// other one know.
+struct FrameStream {
+  explicit FrameStream(std::size_t depth) : frames{depth} {}
+
+  BoundedQueue<std::vector<std::int16_t>> frames;
+  // Set by the decode stage before closing the queue if the file turned out
+  // to be malformed.
+  std::atomic<bool> failed{};
+};
+
+// Handed to the convert stage before the file's first frame is decoded, so
+// the two stages work on it at the same time.
+struct DecodedFile {
+  std::size_t job{};
+  std::uint32_t sample_rate{};
+  std::uint32_t channels{};
+  // Per channel, as far as the file header and the data agree on it.
+  std::uint64_t expected_samples{};
+  std::shared_ptr<FrameStream> stream;
+};
+
+struct ConvertedFile {
+  std::size_t job{};
+  std::vector<std::uint8_t> data;
+};
+
+struct Counters {
+  std::atomic<std::size_t> files{};
+  std::atomic<std::size_t> failed{};
+  std::atomic<std::uint64_t> bytes_read{};
+  std::atomic<std::uint64_t> bytes_written{};
+  std::atomic<std::uint64_t> samples{};
+};
+
+std::int16_t to_int16(float sample) {
+  return static_cast<std::int16_t>(
+      std::clamp(std::lround(sample * 32768.f), -32768l, 32767l));
+}
+
+void write_wav_header(std::uint8_t *out, std::uint32_t channels,
+                      std::uint32_t rate, std::uint32_t data_size) {
+  auto const block_align = static_cast<std::uint16_t>(channels * 2);
+  std::memcpy(out, "RIFF", 4);
+  store_le<std::uint32_t>(out + 4, kWavHeaderSize - 8 + data_size);
+  std::memcpy(out + 8, "WAVEfmt ", 8);
+  store_le<std::uint32_t>(out + 16, 16);
+  // PCM.
+  store_le<std::uint16_t>(out + 20, 1);
+  store_le<std::uint16_t>(out + 22, static_cast<std::uint16_t>(channels));
+  store_le<std::uint32_t>(out + 24, rate);
+  store_le<std::uint32_t>(out + 28, rate * block_align);
+  store_le<std::uint16_t>(out + 32, block_align);
+  store_le<std::uint16_t>(out + 34, 16);
+  std::memcpy(out + 36, "data", 4);
+  store_le<std::uint32_t>(out + 40, data_size);
+}
+
+template <typename Sample>
+void append_samples(std::vector<std::uint8_t> &out,
+                    std::span<Sample const> samples, OutputFormat format) {
+  auto const sample_size =
+      format == OutputFormat::F32 ? sizeof(float) : sizeof(std::int16_t);
+  auto const start = out.size();
+  out.resize(start + samples.size() * sample_size);
+  auto *p = out.data() + start;
+  for (auto const sample : samples) {
+    if (format == OutputFormat::F32) {
+      if constexpr (std::is_same_v<Sample, float>) {
+        store_le(p, std::bit_cast<std::uint32_t>(sample));
+      } else {
+        store_le(p, std::bit_cast<std::uint32_t>(sample * kSampleScale));
+      }
+    } else {
+      if constexpr (std::is_same_v<Sample, float>) {
+        store_le(p, to_int16(sample));
+      } else {
+        store_le(p, sample);
+      }
+    }
+    p += sample_size;
+  }
+}
+
+// Decodes `file` a frame at a time into `stream`, after handing it to the
+// convert stage through `decoded`. Returns false if the file couldn't be
+// handed off, which leaves it to the caller to count as failed.
+bool decode(ReadFile const &file, BoundedQueue<DecodedFile> &decoded) {
+  auto decoder = Decoder::parse(file.data);
+  // Without a sample rate there's nothing to resample from or to put in a
+  // WAV header.
+  if (!decoder || decoder->sample_rate() == 0) {
+    return false;
+  }
+
+  auto const channels = decoder->nbr_channels();
+  auto stream = std::make_shared<FrameStream>(kFramesInFlight);
+  // The header's sample count can't be trusted further than the data backs
+  // it up.
+  auto const expected = std::min<std::uint64_t>(
+      decoder->sample_count(), file.data.size() / 8 * kSliceLen / channels);
+  if (!decoded.push({.job = file.job,
+                     .sample_rate = decoder->sample_rate(),
+                     .channels = channels,
+                     .expected_samples = expected,
+                     .stream = stream})) {
+    return false;
+  }
+
+  // From here on the convert stage owns the file and counts its failures.
+  try {
+    while (true) {
+      std::vector<std::int16_t> frame(kFrameLen * channels);
+      auto const n = decoder->decode_frame(frame);
+      if (n == 0) {
+        break;
+      }
+
+      frame.resize(n * channels);
+      if (!stream->frames.push(std::move(frame))) {
+        break;
+      }
+    }
+    stream->failed = decoder->error();
+  } catch (...) {
+    stream->failed = true;
+  }
+  stream->frames.close();
+  return true;
+}
+
+// Resamples and converts the frames of `file` as they're decoded, so the
+// file is never held in full at its source rate, only compressed and
+// converted.
+std::optional<std::vector<std::uint8_t>>
+convert(DecodedFile const &file, TranscodeOptions const &options,
+        std::uint64_t &samples) {
+  auto const channels = file.channels;
+  auto const rate = options.sample_rate.value_or(file.sample_rate);
+  std::optional<Resampler> resampler;
+  if (rate != file.sample_rate) {
+    resampler =
+        Resampler::create(file.sample_rate, rate, channels, options.quality);
+    if (!resampler) {
+      return std::nullopt;
+    }
+  }
+
+  auto const sample_size = options.format == OutputFormat::F32
+                               ? sizeof(float)
+                               : sizeof(std::int16_t);
+  auto const header_size =
+      options.format == OutputFormat::Wav ? kWavHeaderSize : 0;
+  // Only a guess when resampling.
+  auto const expected = file.expected_samples * rate / file.sample_rate;
+  std::vector<std::uint8_t> out(header_size);
+  out.reserve(header_size + expected * channels * sample_size);
+
+  std::vector<float> resampled;
+  while (auto const frame = file.stream->frames.pop()) {
+    auto const n = frame->size() / channels;
+    samples += n;
+    if (!resampler) {
+      append_samples(out, std::span<std::int16_t const>{*frame},
+                     options.format);
+      continue;
+    }
+
+    resampled.resize(resampler->max_output(n) * channels);
+    auto const m = resampler->process(*frame, resampled);
+    append_samples(out, std::span<float const>{resampled}.first(m * channels),
+                   options.format);
+  }
+
+  if (file.stream->failed) {
+    return std::nullopt;
+  }
+
+  if (resampler) {
+    resampled.resize(resampler->max_output(0) * channels);
+    auto const m = resampler->flush(resampled);
+    append_samples(out, std::span<float const>{resampled}.first(m * channels),
+                   options.format);
+  }
+
+  auto const data_size = out.size() - header_size;
+  if (options.format == OutputFormat::Wav) {
+    if (data_size >
+        std::numeric_limits<std::uint32_t>::max() - kWavHeaderSize) {
+      return std::nullopt;
+    }
+
+    write_wav_header(out.data(), channels, rate,
+                     static_cast<std::uint32_t>(data_size));
+  }
+
+  return out;
+}
+
+std::optional<std::vector<std::uint8_t>>
+read_file(std::filesystem::path const &path) {
+  std::ifstream fs{path, std::ifstream::in | std::ifstream::binary};
+  if (!fs) {
+    return std::nullopt;
+  }
+
+  return std::vector<std::uint8_t>(std::istreambuf_iterator<char>{fs}, {});
+}
+
+bool write_file(std::filesystem::path const &path,
+                std::span<std::uint8_t const> data) {
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  std::ofstream fs{path, std::ofstream::out | std::ofstream::binary};
+  fs.write(reinterpret_cast<char const *>(data.data()),
+           static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(fs);
+}
+
+// Runs `step` for one file and counts the file as failed if it returns
+// false or throws, e.g. std::bad_alloc for a file too large to convert. An
+// exception leaving a stage's thread would terminate the process.
+template <typename Step>
+void for_file(std::atomic<std::size_t> &failed, Step step) {
+  try {
+    if (!step()) {
+      ++failed;
+    }
+  } catch (...) {
+    ++failed;
+  }
+}
+
+// Runs `work` on `threads` threads and closes `out` once the last of them is
+// done, letting the next stage know nothing more is coming. `work` handles
+// each file with for_file(), so this only guards against the queues
+// themselves throwing, and still closes `out` so the next stage can't hang.
+template <typename Out, typename Work>
+void start_stage(std::vector<std::jthread> &stages, std::size_t threads,
+                 BoundedQueue<Out> &out, Work work) {
+  auto running = std::make_shared<std::atomic<std::size_t>>(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    stages.emplace_back([&out, work, running] {
+      try {
+        work();
+      } catch (...) {
+      }
+      if (--*running == 0) {
+        out.close();
+      }
+    });
+  }
+}
+
+} // namespace
+
+TranscodeStats transcode(std::span<TranscodeJob const> jobs,
+                         TranscodeOptions const &options) {
+  auto const threads = [](std::size_t n) {
+    return n > 0 ? n : std::max(1u, std::thread::hardware_concurrency());
+  };
+
+  Counters counters;
+  BoundedQueue<ReadFile> read{options.queue_depth};
+  BoundedQueue<DecodedFile> decoded{options.queue_depth};
+  BoundedQueue<ConvertedFile> converted{options.queue_depth};
+  std::atomic<std::size_t> next_job{0};
+
+  {
+    std::vector<std::jthread> stages;
+    start_stage(stages, threads(options.read_threads), read, [&] {
+      for (auto job = next_job++; job < jobs.size(); job = next_job++) {
+        for_file(counters.failed, [&] {
+          auto data = read_file(jobs[job].in);
+          if (!data) {
+            return false;
+          }
+
+          counters.bytes_read += data->size();
+          return read.push({job, *std::move(data)});
+        });
+      }
+    });
+
+    start_stage(stages, threads(options.decode_threads), decoded, [&] {
+      while (auto file = read.pop()) {
+        for_file(counters.failed, [&] { return decode(*file, decoded); });
+      }
+    });
+
+    start_stage(stages, threads(options.convert_threads), converted, [&] {
+      while (auto file = decoded.pop()) {
+        for_file(counters.failed, [&] {
+          std::uint64_t samples = 0;
+          auto data = convert(*file, options, samples);
+          if (!data) {
+            return false;
+          }
+
+          counters.samples += samples;
+          return converted.push({file->job, *std::move(data)});
+        });
+        // Lets the decode stage stop if this gave up before the last frame.
+        file->stream->frames.close();
+      }
+    });
+
+    for (std::size_t i = 0; i < threads(options.write_threads); ++i) {
+      stages.emplace_back([&] {
+        try {
+          while (auto file = converted.pop()) {
+            for_file(counters.failed, [&] {
+              if (!write_file(jobs[file->job].out, file->data)) {
+                return false;
+              }
+
+              ++counters.files;
+              counters.bytes_written += file->data.size();
+              return true;
+            });
+          }
+        } catch (...) {
+        }
+      });
+    }
+  }
+
+  return {.files = counters.files,
+          .failed = counters.failed,
+          .bytes_read = counters.bytes_read,
+          .bytes_written = counters.bytes_written,
+          .samples = counters.samples};
+}
+
+} // namespace qoa
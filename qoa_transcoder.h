@@ -0,0 +1,72 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_TRANSCODER_H_
+#define AUDIO_QOA_TRANSCODER_H_
+
+#include "qoa_resampler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace qoa {
+
+enum class OutputFormat {
+    // 16-bit PCM WAV.
+    Wav,
+    // Headerless interleaved little-endian int16.
+    Raw,
+    // Headerless interleaved little-endian float in [-1, 1).
+    F32,
+};
+
+struct TranscodeJob {
+    std::filesystem::path in;
+    std::filesystem::path out;
+};
+
+struct TranscodeOptions {
+    OutputFormat format{OutputFormat::Wav};
+    // Resample to this rate if set and different from the file's.
+    std::optional<std::uint32_t> sample_rate{};
+    Resampler::Quality quality{Resampler::Quality::Sinc};
+
+    // Threads per stage, 0 meaning one per hardware thread.
+    std::size_t read_threads{2};
+    std::size_t decode_threads{0};
+    std::size_t convert_threads{0};
+    std::size_t write_threads{2};
+    // Files waiting between two stages. Together with the thread counts this
+    // bounds how many files are held in memory at once.
+    std::size_t queue_depth{4};
+};
+
+struct TranscodeStats {
+    std::size_t files{};
+    std::size_t failed{};
+    std::uint64_t bytes_read{};
+    std::uint64_t bytes_written{};
+    // Per channel, at the source rate.
+    std::uint64_t samples{};
+};
+
+// Converts QOA files to uncompressed audio in a pipeline of read, decode,
+// convert and write stages connected by bounded queues, so disk and CPU work
+// on different files at the same time and a stage that falls behind holds
+// back the ones before it instead of letting work pile up in memory.
+//
+// A file is handed from the decode stage to the convert stage, which
+// resamples and converts it, before it's decoded, and then a few frames at a
+// time as they're decoded. So a file in flight is only held in full
+// compressed and converted, never decoded at its source rate. Files are read
+// and written whole. Files that can't be read, decoded, converted or written
+// are counted as failed, including files with a sample rate of 0.
+TranscodeStats transcode(std::span<TranscodeJob const>, TranscodeOptions const & = {});
+
+} // namespace qoa
+
+#endif
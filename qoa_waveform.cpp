@@ -0,0 +1,232 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "qoa_waveform.h"
+
+#include "qoa.h"
+#include "qoa_endian.h"
+#include "qoa_thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace qoa {
+namespace {
+
+constexpr std::size_t kHeaderSize = 24;
+constexpr std::size_t kBucketSize = 6;
+constexpr std::uint32_t kVersion = 1;
+
+template <typename T> void append_le(std::vector<std::uint8_t> &out, T v) {
+  out.resize(out.size() + sizeof(T));
+  store_le(&out[out.size() - sizeof(T)], v);
+}
+
+// A bucket while it's being built, so buckets can be merged exactly.
+struct Accumulator {
+  int min{32767};
+  int max{-32768};
+  std::uint64_t sum_of_squares{};
+  std::uint64_t samples{};
+
+  void add(int s) {
+    min = std::min(min, s);
+    max = std::max(max, s);
+    sum_of_squares += static_cast<std::uint64_t>(s * s);
+    ++samples;
+  }
+
+  void merge(Accumulator const &o) {
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+    sum_of_squares += o.sum_of_squares;
+    samples += o.samples;
+  }
+
+  Waveform::Bucket bucket() const {
+    if (samples == 0) {
+      return {};
+    }
+
+    auto const rms = std::sqrt(static_cast<double>(sum_of_squares) /
+                               static_cast<double>(samples));
+    return {.min = static_cast<std::int16_t>(min),
+            .max = static_cast<std::int16_t>(max),
+            .rms = static_cast<std::uint16_t>(std::lround(rms))};
+  }
+};
+
+// The smallest-bucket accumulators for a run of frames, starting at bucket
+// `first_bucket`. Runs can start and end inside a bucket, which is merged
+// with the neighbouring run's part of it afterwards.
+struct Run {
+  std::uint64_t first_bucket{};
+  std::vector<Accumulator> buckets;
+};
+
+Run summarize_frames(std::span<std::uint8_t const> qoa,
+                     std::span<FrameIndex::Frame const> frames) {
+  auto decoder = *Decoder::parse(qoa);
+  auto const channels = decoder.nbr_channels();
+  auto const end = frames.back().first_sample + frames.back().sample_count;
+  auto const first = frames.front().first_sample / Waveform::kBucketSizes[0];
+  auto const last = (end - 1) / Waveform::kBucketSizes[0];
+  Run run{.first_bucket = first,
+          .buckets = std::vector<Accumulator>((last - first + 1) * channels)};
+
+  std::vector<std::int16_t> samples(kFrameLen * channels);
+  decoder.seek(frames.front().offset, frames.front().first_sample);
+  auto pos = frames.front().first_sample;
+  for (std::size_t f = 0; f < frames.size(); ++f) {
+    auto const n = decoder.decode_frame(samples);
+    for (std::size_t i = 0; i < n; ++i, ++pos) {
+      auto *bucket =
+          &run.buckets[(pos / Waveform::kBucketSizes[0] - first) * channels];
+      for (std::size_t ch = 0; ch < channels; ++ch) {
+        bucket[ch].add(samples[i * channels + ch]);
+      }
+    }
+  }
+
+  return run;
+}
+
+} // namespace
+
+std::optional<Waveform> Waveform::build(std::span<std::uint8_t const> qoa,
+                                        std::size_t threads) {
+  auto index = index_frames(qoa);
+  if (!index) {
+    return std::nullopt;
+  }
+
+  auto const &frames = index->frames;
+  auto const samples = index->sample_count();
+  Waveform waveform;
+  waveform.channels_ = index->nbr_channels;
+  waveform.sample_rate_ = index->sample_rate;
+  waveform.sample_count_ = samples;
+  if (frames.empty()) {
+    return waveform;
+  }
+
+  ThreadPool pool{threads};
+  auto const runs_wanted = std::min(frames.size(), pool.size());
+  std::vector<Run> runs(runs_wanted);
+  for (std::size_t r = 0; r < runs_wanted; ++r) {
+    auto const first = frames.size() * r / runs_wanted;
+    auto const last = frames.size() * (r + 1) / runs_wanted;
+    pool.submit([&, first, last, r] {
+      runs[r] =
+          summarize_frames(qoa, std::span{frames}.subspan(first, last - first));
+    });
+  }
+  pool.wait();
+
+  auto const channels = std::size_t{waveform.channels_};
+  std::vector<Accumulator> level((samples - 1) / kBucketSizes[0] * channels +
+                                 channels);
+  for (auto const &run : runs) {
+    for (std::size_t i = 0; i < run.buckets.size(); ++i) {
+      level[run.first_bucket * channels + i].merge(run.buckets[i]);
+    }
+  }
+
+  for (std::size_t l = 0; l < kBucketSizes.size(); ++l) {
+    if (l > 0) {
+      // Every level's buckets are made of a whole number of the previous
+      // level's.
+      auto const ratio = kBucketSizes[l] / kBucketSizes[l - 1];
+      auto const buckets = level.size() / channels;
+      std::vector<Accumulator> next((buckets + ratio - 1) / ratio * channels);
+      for (std::size_t b = 0; b < buckets; ++b) {
+        for (std::size_t ch = 0; ch < channels; ++ch) {
+          next[b / ratio * channels + ch].merge(level[b * channels + ch]);
+        }
+      }
+      level = std::move(next);
+    }
+
+    auto &out = waveform.levels_[l];
+    out.reserve(level.size());
+    for (auto const &acc : level) {
+      out.push_back(acc.bucket());
+    }
+  }
+
+  return waveform;
+}
+
+std::optional<Waveform>
+Waveform::parse(std::span<std::uint8_t const> sidecar) {
+  if (sidecar.size() < kHeaderSize ||
+      !std::equal(sidecar.begin(), sidecar.begin() + 4, "qoaw") ||
+      load_le<std::uint32_t>(&sidecar[4]) != kVersion) {
+    return std::nullopt;
+  }
+
+  Waveform waveform;
+  waveform.channels_ = load_le<std::uint32_t>(&sidecar[8]);
+  waveform.sample_rate_ = load_le<std::uint32_t>(&sidecar[12]);
+  waveform.sample_count_ = load_le<std::uint64_t>(&sidecar[16]);
+  // Far more than a QOA file can hold, but keeps the sizes below from
+  // overflowing.
+  constexpr std::uint64_t kMaxSamples = std::uint64_t{1} << 48;
+  if (waveform.channels_ == 0 || waveform.channels_ > kMaxChannels ||
+      waveform.sample_count_ > kMaxSamples) {
+    return std::nullopt;
+  }
+
+  auto pos = kHeaderSize;
+  for (std::size_t l = 0; l < kBucketSizes.size(); ++l) {
+    auto const buckets =
+        (waveform.sample_count_ + kBucketSizes[l] - 1) / kBucketSizes[l] *
+        waveform.channels_;
+    if ((sidecar.size() - pos) / kBucketSize < buckets) {
+      return std::nullopt;
+    }
+
+    auto &level = waveform.levels_[l];
+    level.resize(buckets);
+    for (auto &bucket : level) {
+      bucket = {.min = load_le<std::int16_t>(&sidecar[pos]),
+                .max = load_le<std::int16_t>(&sidecar[pos + 2]),
+                .rms = load_le<std::uint16_t>(&sidecar[pos + 4])};
+      pos += kBucketSize;
+    }
+  }
+
+  return waveform;
+}
+
+std::vector<std::uint8_t> Waveform::serialize() const {
+  auto size = kHeaderSize;
+  for (auto const &level : levels_) {
+    size += level.size() * kBucketSize;
+  }
+
+  std::vector<std::uint8_t> out{'q', 'o', 'a', 'w'};
+  out.reserve(size);
+  append_le(out, kVersion);
+  append_le(out, channels_);
+  append_le(out, sample_rate_);
+  append_le(out, sample_count_);
+  for (auto const &level : levels_) {
+    for (auto const &bucket : level) {
+      append_le(out, bucket.min);
+      append_le(out, bucket.max);
+      append_le(out, bucket.rms);
+    }
+  }
+
+  return out;
+}
+
+} // namespace qoa
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2023 Robin Lindén <dev@robinlinden.eu>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef AUDIO_QOA_WAVEFORM_H_
+#define AUDIO_QOA_WAVEFORM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace qoa {
+
+// Min/max/RMS summaries of a QOA file at a few fixed zoom levels, for
+// drawing waveforms without decoding anything once it's been built.
+//
+// Sidecar layout, all integers little-endian:
+//   header   "qoaw", u32 version, u32 channels, u32 sample rate,
+//            u64 samples per channel
+//   levels   per level: Waveform::Bucket for every bucket, interleaved by
+//            channel, as i16 min, i16 max, u16 RMS
+class Waveform {
+public:
+    // Samples per channel summarized by a bucket at each level.
+    static constexpr std::array<std::size_t, 3> kBucketSizes{256, 4096, 65536};
+
+    struct Bucket {
+        std::int16_t min{};
+        std::int16_t max{};
+        std::uint16_t rms{};
+    };
+
+    // Decodes the file with its frames split between `threads` threads, 0
+    // meaning one per hardware thread. Returns nullopt if it isn't a valid
+    // QOA file.
+    static std::optional<Waveform> build(std::span<std::uint8_t const> qoa, std::size_t threads = 0);
+
+    static std::optional<Waveform> parse(std::span<std::uint8_t const> sidecar);
+    std::vector<std::uint8_t> serialize() const;
+
+    std::uint32_t nbr_channels() const { return channels_; }
+    std::uint32_t sample_rate() const { return sample_rate_; }
+    std::uint64_t sample_count() const { return sample_count_; }
+
+    // The buckets of level 0 to kBucketSizes.size() - 1, interleaved by
+    // channel, or none for any other level. The last bucket covers what's
+    // left at the end.
+    std::span<Bucket const> level(std::size_t level) const {
+        return level < levels_.size() ? std::span<Bucket const>{levels_[level]} : std::span<Bucket const>{};
+    }
+
+private:
+    std::uint32_t channels_{};
+    std::uint32_t sample_rate_{};
+    std::uint64_t sample_count_{};
+    std::array<std::vector<Bucket>, kBucketSizes.size()> levels_{};
+};
+
+} // namespace qoa
+
+#endif